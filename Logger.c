@@ -12,24 +12,88 @@
  *  Dioda LED2 PD6 czerwona - sygnalizacja trwania operacji zapisu danych na kart SD cigym wieceniem w trakcie trwania tej operacji,
  *                            sygnalizacja innych zdarze (gwnie bdw) miganiem
  *  W dokumentacji znajduje si dokadny opis migni diod i ich znaczenia.
+ *
+ *  Wejcie PD2 (INT0) - wyjcie INT zegara RTC (otwarty dren), ktrego timer odliczajcy ogranicza czas oczekiwania rekordw w buforze na zapis na kart SD
+ *  Wejcie PB3 (AIN1) - wyjcie CLKOUT zegara RTC (otwarty dren, 1 Hz), wyznaczajce pocztek kadej sekundy dla milisekund w rekordach
+ *  Wejcia PA0 - PA7  - kontaktrony drzwi 1 - 8, prbkowane przez Timer/Counter0 (zmiany wykryte w jednej prbce maj wsplny znacznik czasu)
+ *
+ *  Rekordy, ktre nie mieszcz si w buforze przy braku karty SD, przechowywane s w pamici EEPROM i przepisywane na kart po jej wykryciu.
+ *  Seria szybkich zmian stanu tych samych drzwi (np. drzwi poruszanych przez wiatr) zapisywana jest jako dwa rekordy podsumowania.
  */ 
 
 #include <avr/io.h>
 #include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include <avr/sleep.h>
 #include <stdint-gcc.h>
 #include <stdio.h>
 #include <string.h>
 #include "ff.h"		/* Deklaracje z API FatFS'a */
 #include "utils.h"
 #include "rtc.h"
+#include "twi.h"
+#include "led.h"
+#include "spill.h"
+#include "doors.h"
+#include "config.h"
 #include <util/delay.h>
 
 
 
 #pragma region ZmienneStaleMakra
 
-/// Rozmiar bufora (liczba 20-bajtowych elementw do przechowywania rekordw o zdarzeniach).
-#define BUFFER_SIZE 20
+/// Rozmiar rekordu tekstowego, tworzonego z rekordu z bufora przy zapisie na kart SD (napis "YY-MM-DD HH:ii:SS.mmm c" z numerem drzwi i liczb zmian stanu drzwi na kocu, wraz ze znakiem \0).
+#define RECORD_SIZE 26
+
+/// Indeks kodu zdarzenia w rekordzie (poprzedzaj go data, czas z milisekundami i spacja).
+#define RECORD_CODE 22
+
+/// Indeks numeru drzwi w rekordzie (0 dla zdarze niezwizanych z drzwiami).
+#define RECORD_CHANNEL 23
+
+/// Indeks liczby zmian stanu drzwi w rekordzie (0 dla zwykych rekordw, patrz @see FlapEnd).
+#define RECORD_COUNT 24
+
+/// Format rekordu w buforze: data i czas zdarzenia z dokadnoci do milisekund, kod zdarzenia, numer drzwi i liczba zmian stanu drzwi.
+#define RECORD_FORMAT "%02d-%02d-%02d %02d:%02d:%02d.%03u %c%c%c"
+
+/// Kod rekordu w buforze lub w pamici EEPROM, ktry zawiera now dat i czas ustawione w RTC (nastpuje po rekordzie o zdarzeniu 4).
+#define SPILL_NEW_DATE 7
+
+/// Liczba zmian stanu tych samych drzwi w oknie FLAP_WINDOW, po przekroczeniu ktrej kolejne zmiany s zliczane zamiast zapisywania.
+#define FLAP_TOGGLES 6
+
+/**
+ * Dugo okna (w sekundach), w ktrym zliczane s zmiany stanu drzwi.<br>
+ * Zliczanie koczy si, gdy drzwi nie zmieni stanu przez FLAP_WINDOW sekund - zapisywane jest wtedy podsumowanie serii zmian.
+ */
+#define FLAP_WINDOW 60
+
+#if FLAP_WINDOW > 255
+#error FLAP_WINDOW does not fit in uint8_t.
+#endif
+
+/// Maksymalna liczba drzwi, ktrych zmiany stanu mog by jednoczenie zliczane (zmiany pozostaych drzwi zapisywane s zwykymi rekordami).
+#define FLAP_RUNS 2
+
+#if LOG_FORMAT
+/// Rozmiar rekordu (i nagwka) binarnego pliku z logiem - potga 2, wic rekordy nie przekraczaj granic 512-bajtowych sektorw.
+#define LOG_RECORD_SIZE SPILL_RECORD_SIZE
+
+#if 512 % LOG_RECORD_SIZE
+#error LOG_RECORD_SIZE must divide the sector size.
+#endif
+
+/// Wersja formatu binarnego pliku z logiem, zapisywana w nagwku pliku (zmieniana przy kadej zmianie ukadu rekordw).
+#define LOG_VERSION 1
+#endif
+
+/// Rozmiar tablicy CLMT pliku z logiem (nagwek, 3 fragmenty po 2 elementy i znacznik koca).
+#define CLMT_SIZE 8
+
+#if !_USE_OPENLOC
+#error The log file is reopened with f_openloc, set _USE_OPENLOC to 1 in ffconf.h.
+#endif
 
 /// Przestrze robocza FatFS, potrzebna dla kadego wolumenu
 FATFS FatFs;
@@ -37,6 +101,37 @@ FATFS FatFs;
 /// Obiekt (uchwyt do) pliku, potrzebny dla kadego otwartego pliku
 FIL Fil;
 
+/**
+ * Tablica odwzorowa klastrw (CLMT) pliku z logiem, uywana przez FatFS w trybie szybkiego przesuwania wskanika pliku (fast seek).<br>
+ * Przechowywana pomidzy kolejnymi zapisami bufora, dziki czemu przejcie na koniec pliku nie wymaga odczytywania caego acucha klastrw z tablicy FAT.
+ * Warto 0 w pierwszym elemencie oznacza niewan tablic, warto 1 - plik (o klastrze pocztkowym zapisanym w drugim elemencie)
+ * zbyt pofragmentowany, by opisa go w tablicy.
+ */
+DWORD clmt[CLMT_SIZE];
+
+/**
+ * Pooenie wpisu katalogowego pliku z logiem (sektor i indeks wpisu), zapamitane przy jego wyszukaniu.<br>
+ * Ponowne otwarcie pliku wymaga jedynie odczytu tego sektora i porwnania nazwy oraz klastra pocztkowego, bez przeszukiwania katalogu.
+ */
+FILOC log_loc;
+
+/// Nazwa pliku z logiem, do ktrego odnosi si pooenie wpisu katalogowego log_loc (pusty napis, jeli aden plik nie by jeszcze otwierany).
+char log_name[13] = "";
+
+/// Determinuje czy plik konfiguracyjny zosta odczytany z biecej karty SD (zerowana po wykryciu braku karty).
+uint8_t config_loaded = 0;
+
+#if LOG_ROTATION
+/// Nazwa pliku z logiem na kolejny dzie (miesic), tworzonego zawczasu w ptli gwnej programu.
+char next_name[13] = "";
+
+/// Pooenie wpisu katalogowego pliku next_name (warto 0 w polu sect oznacza, e plik nie zosta jeszcze utworzony).
+FILOC next_loc;
+
+/// Determinuje czy ptla gwna programu ma utworzy plik next_name.
+volatile uint8_t log_prepare = 0;
+#endif
+
 /**
  * Etap operacji zmiany ustawie daty i czasu w RTC.<br>
  * Warto -1 oznacza tryb normalny, wartoci od 0 do 5 to okrelanie wartoci kolejnych elementw daty i czasu, warto 6 to oczekiwanie na potwierdzenie
@@ -57,16 +152,83 @@ uint8_t set_rtc_values[6];
 time now;
 
 /* Flagi bdw i biecego stanu wybranych elementw urzdzenia. */
-volatile flags device_flags = {0, 0, 0, 0, 0, 0, 1, 0};
+volatile flags device_flags = {0, 0, 0, 0, 1};
 
-/// Bufor przechowujcy do 20 rekordw informacyjnych o zarejestrowanych zdarzeniach.
-char buffer[BUFFER_SIZE][20] = {{0,},};
+/**
+ * Seria szybkich zmian stanu drzwi, zliczanych zamiast zapisywania.
+ * @field channel Numer drzwi (0 - element nieuywany)
+ * @field toggles Liczba zliczonych zmian stanu drzwi
+ * @field event Kod ostatniego zdarzenia (0 - drzwi otwarte, 1 - drzwi zamknite)
+ * @field first Data i czas pierwszej zliczonej zmiany
+ * @field last Data i czas ostatniej zliczonej zmiany
+ */
+typedef struct {
+	uint8_t channel;
+	uint8_t toggles;
+	uint8_t event;
+	time first;
+	time last;
+} flap_run;
+
+/// Serie zmian stanu drzwi, ktre s w trakcie zliczania.
+flap_run flap_runs[FLAP_RUNS];
+
+/// Liczba zmian stanu poszczeglnych drzwi w biecym oknie (indeks 0 - drzwi 1).
+uint8_t flap_count[8];
 
-/// Przechowuje indeks elementu bufora, do ktrego zapisany zostanie najnowszy rekord o zarejestrowanym zdarzeniu.
+/// Warto flap_clock na pocztku biecego okna, a w trakcie zliczania serii - przy ostatniej zmianie stanu drzwi.
+uint8_t flap_start[8];
+
+/// Licznik sekund (zwikszany w ptli gwnej programu), wzgldem ktrego odmierzane s okna zliczania zmian stanu drzwi.
+uint8_t flap_clock = 0;
+
+/**
+ * Bufor przechowujcy rekordy informacyjne o zarejestrowanych zdarzeniach, podzielony na dwa banki po BUFFER_SIZE rekordw.<br>
+ * Nowe rekordy trafiaj do aktywnego banku (buffer_bank), a drugi bank zapisywany jest na kart SD (zapis wymuszany jest po settings.buffer rekordach).<br>
+ * Rekordy s upakowane tak jak rekordy w pamici EEPROM (patrz @see SpillPack) - zamiana na wiersze pliku z logiem nastpuje dopiero przy zapisie,
+ * a zaoszczdzona pami RAM mieci drugi bufor sektora FatFS (_FS_WINDOWS w pliku ffconf.h).
+ */
+uint8_t buffer[2][BUFFER_SIZE][SPILL_RECORD_SIZE] = {{{0,},},};
+
+/// Indeks aktywnego banku bufora.
+volatile uint8_t buffer_bank = 0;
+
+/// Przechowuje indeks elementu aktywnego banku, do ktrego zapisany zostanie najnowszy rekord o zarejestrowanym zdarzeniu.
 volatile uint8_t buffer_index = 0;
 
-/// Tablica nazw zdarze wykrywanych przez urzdzenie, uywana przy zapisie danych z bufora na kart SD.
-const char* events_names[6] = { "opened", "closed", "turned on", "no file system", "date time changed", "SD inserted" };
+/// Liczba rekordw w nieaktywnym banku, ktre czekaj na zapis na kart SD (niezerowa po nieudanym zapisie).
+volatile uint8_t drain_count = 0;
+
+/// Determinuje czy trwa zapis na kart SD (procedury obsugi przerwa nie mog wtedy korzysta z karty SD ani wywoywa funkcji SaveBuffer).
+volatile uint8_t flush_busy = 0;
+
+/// Determinuje czy timer RTC odlicza czas do zapisu bufora (uruchamiany jest przy pierwszym rekordzie w buforze, a nie przy kadym kolejnym).
+volatile uint8_t flush_armed = 0;
+
+/// Determinuje czy ptla gwna programu ma zapisa bufor na kart SD (po osigniciu progu settings.high lub upywie settings.idle sekund bez zmian stanu drzwi).
+volatile uint8_t flush_request = 0;
+
+/// Liczba sekund od ostatniej zmiany stanu drzwi, odmierzana w ptli gwnej programu, gdy w buforze czekaj rekordy.
+uint8_t flush_idle = 0;
+
+/// Ustawienie 'buffer' odczytane z pliku konfiguracyjnego, ktre zacznie obowizywa przy najbliszej zamianie bankw (patrz @see SwapBanks).
+uint8_t next_buffer = BUFFER_SIZE;
+
+/// Ustawienie 'high' odczytane z pliku konfiguracyjnego, ktre zacznie obowizywa przy najbliszej zamianie bankw.
+uint8_t next_high = FLUSH_HIGH;
+
+/* nazwy zdarze przechowywane s w pamici programu, aby nie zajmoway pamici RAM */
+const char event_opened[] PROGMEM = "opened";
+const char event_closed[] PROGMEM = "closed";
+const char event_turned_on[] PROGMEM = "turned on";
+const char event_no_file_system[] PROGMEM = "no file system";
+const char event_date_time_changed[] PROGMEM = "date time changed";
+const char event_sd_inserted[] PROGMEM = "SD inserted";
+const char event_flapping[] PROGMEM = "flapping";
+
+/// Tablica nazw zdarze wykrywanych przez urzdzenie (w pamici programu), uywana przy zapisie danych z bufora na kart SD.
+PGM_P const events_names[7] PROGMEM = { event_opened, event_closed, event_turned_on, event_no_file_system, event_date_time_changed, event_sd_inserted,
+	event_flapping };
 
 #pragma endregion ZmienneStaleMakra
 
@@ -81,16 +243,19 @@ DWORD get_fattime (void)
 {
 	DWORD current_time;
 	
-	RtcGetTime(&now);
+	/* data i czas odczytywane s w tle w ptli gwnej programu, wic zapis na kart SD nie musi czeka na transmisj z RTC
+	 * (RTC odpytywany jest tylko wtedy, gdy ostatni odczyt si nie powid) */
+	if(!rtc_time_valid)
+		RtcGetTime(&now);
 	
 	/* pakowanie daty i czasu do DWORD'a */
 	current_time =
-		((DWORD)(now.years + 20) << 25)
-	  | ((DWORD) now.months << 21)
-	  | ((DWORD) now.days << 16)
-	  | ((DWORD) now.hours << 11)
-	  | ((DWORD) now.minutes << 5)
-	  | ((DWORD) now.seconds >> 1); /* minuty podawane s z dokadnoci do 30 sekund, dlatego przechowywane tu s sekundy z zakresu 0 - 29 */
+		((DWORD)(rtc_time.years + 20) << 25)
+	  | ((DWORD) rtc_time.months << 21)
+	  | ((DWORD) rtc_time.days << 16)
+	  | ((DWORD) rtc_time.hours << 11)
+	  | ((DWORD) rtc_time.minutes << 5)
+	  | ((DWORD) rtc_time.seconds >> 1); /* minuty podawane s z dokadnoci do 30 sekund, dlatego przechowywane tu s sekundy z zakresu 0 - 29 */
 	
 	return current_time;
 }
@@ -98,27 +263,517 @@ DWORD get_fattime (void)
 
 
 /**
- * Zapisuje dane z bufora na kart SD oraz przesuwa wskanik bufora (buffer_index) na pocztek.<br>
+ * Sprawdza czy tablica CLMT opisuje plik otwarty w obiekcie Fil, tzn. czy zaczyna si od tego samego klastra
+ * i czy zawiera tyle klastrw, ile wynika z rozmiaru pliku.
+ * @return 1 jeli tablica moe zosta uyta do szybkiego przesuwania wskanika pliku, 0 w przeciwnym razie.
+ */
+uint8_t ClmtValid(void)
+{
+	/* liczba klastrw opisanych w tablicy */
+	DWORD n = 0;
+	/* zmienna iteracyjna */
+	uint8_t i;
+	
+	if(clmt[0] < 2)
+		return 0;
+	
+	for(i = 1; i < CLMT_SIZE - 1 && clmt[i]; i += 2)
+		n += clmt[i];
+	
+	/* pierwszy fragment musi zaczyna si od klastra pocztkowego pliku (pusty plik nie ma adnego klastra) */
+	if(Fil.sclust != (n ? clmt[2] : 0))
+		return 0;
+	
+	/* liczba klastrw pliku, bez 32-bitowego dzielenia (rozmiar klastra jest potg 2) */
+	return n == (f_size(&Fil) + ((DWORD)512 << FatFs.csshift) - 1) >> (9 + FatFs.csshift);
+}
+
+
+
+/**
+ * Tworzy nazw pliku z logiem, do ktrego ma trafi rekord z bufora.
+ * @param name Bufor (co najmniej 13 znakw), do ktrego zapisana zostanie nazwa pliku.
+ * @param record Rekord z bufora, zaczynajcy si od daty w formacie "YY-MM-DD".
+ */
+void LogName(char *name, const char *record)
+{
+#if LOG_ROTATION
+	/* przedrostek z ustawie */
+	name[0] = settings.log[0];
+	name[1] = settings.log[1];
+	
+	/* rok i miesic */
+	name[2] = record[0];
+	name[3] = record[1];
+	name[4] = record[3];
+	name[5] = record[4];
+	
+#if LOG_ROTATION == 1
+	/* dzie */
+	name[6] = record[6];
+	name[7] = record[7];
+	
+	strcpy(name + 8, LOG_EXTENSION);
+#else
+	strcpy(name + 6, LOG_EXTENSION);
+#endif
+#else
+	strcpy(name, settings.log);
+#endif
+}
+
+
+
+#if LOG_ROTATION
+/**
+ * Zamienia nazw pliku z logiem na nazw pliku z kolejnego dnia (miesica).
+ * @param name Nazwa pliku utworzona przez funkcj @see LogName
+ */
+void NextLogName(char *name)
+{
+	/* skadowe daty zapisanej w nazwie pliku */
+	uint8_t years = (name[2] - '0') * 10 + name[3] - '0';
+	uint8_t months = (name[4] - '0') * 10 + name[5] - '0';
+#if LOG_ROTATION == 1
+	uint8_t days = (name[6] - '0') * 10 + name[7] - '0';
+	/* liczba dni w miesicu (rok przestpny okrelany jest tak samo, jak przy ustawianiu daty w RTC) */
+	uint8_t last = months == 2 ? (years % 4 ? 28 : 29) : (months == 4 || months == 6 || months == 9 || months == 11) ? 30 : 31;
+	
+	/* kolejny dzie tego samego miesica */
+	if(++days <= last)
+	{
+		name[6] = '0' + days / 10;
+		name[7] = '0' + days % 10;
+		
+		return;
+	}
+	
+	/* pierwszy dzie kolejnego miesica */
+	name[6] = '0';
+	name[7] = '1';
+#endif
+	
+	/* kolejny miesic, po grudniu - stycze kolejnego roku */
+	if(++months > 12)
+	{
+		months = 1;
+		years = (years + 1) % 100;
+		
+		name[2] = '0' + years / 10;
+		name[3] = '0' + years % 10;
+	}
+	
+	name[4] = '0' + months / 10;
+	name[5] = '0' + months % 10;
+}
+#endif
+
+
+
+/**
+ * Otwiera (w razie potrzeby tworzy) plik z logiem o nazwie log_name i ustawia wskanik pliku na jego kocu.<br>
+ * Jeli to moliwe, wcza tryb szybkiego przesuwania wskanika pliku, budujc w razie potrzeby tablic CLMT od nowa.<br>
+ * Do pustego pliku binarnego zapisuje nagwek: znaki "DLOG", wersj formatu, rozmiar rekordu, stulecie dat w rekordach i bajt zarezerwowany.
+ * @return FR_OK jeli do pliku mona dopisywa rekordy, w przeciwnym razie kod bdu zwrcony przez FatFS.
+ */
+FRESULT OpenLog(void)
+{
+	FRESULT res;
+#if LOG_FORMAT
+	/* nagwek binarnego pliku z logiem */
+	BYTE header[LOG_RECORD_SIZE] = { 'D', 'L', 'O', 'G', LOG_VERSION, LOG_RECORD_SIZE, 20, 0 };
+	/* liczba bajtw zapisanych przez funkcj f_write */
+	UINT bw;
+#endif
+	
+	/* prba otwarcia/utworzenia pliku, do ktrego zapisywane s informacje o wykrytych przez urzdzenie zdarzeniach */
+	res = f_openloc(&Fil, log_name, FA_WRITE | FA_OPEN_ALWAYS, &log_loc);
+	
+	if(res != FR_OK)
+		return res;
+	
+	/* wczenie trybu szybkiego przesuwania wskanika pliku, jeli tablica CLMT nie pasuje do pliku, naley j zbudowa od nowa */
+	Fil.cltbl = clmt;
+	
+	if(!ClmtValid())
+	{
+		/* plik, ktrego fragmenty nie mieszcz si w tablicy, obsugiwany jest w zwykym trybie (bez ponownych prb budowania tablicy) */
+		if(clmt[0] == 1 && clmt[1] == Fil.sclust)
+			Fil.cltbl = NULL;
+		else
+		{
+			clmt[0] = CLMT_SIZE;
+			
+			if(f_lseek(&Fil, CREATE_LINKMAP) != FR_OK)
+			{
+				Fil.cltbl = NULL;
+				clmt[0] = 1;
+				clmt[1] = Fil.sclust;
+			}
+		}
+	}
+	
+#if LOG_FORMAT
+	/* nowy plik binarny zaczyna si od nagwka (niepeny nagwek, pozostay po bdzie zapisu, zostanie nadpisany) */
+	if(f_size(&Fil) < LOG_RECORD_SIZE)
+	{
+		res = f_write(&Fil, header, LOG_RECORD_SIZE, &bw);
+		
+		return res == FR_OK && bw != LOG_RECORD_SIZE ? FR_DISK_ERR : res;
+	}
+	
+	/* ustawienie wskanika w pliku na kocu ostatniego penego rekordu (niepeny rekord, pozostay po bdzie zapisu, zostanie nadpisany) */
+	return f_lseek(&Fil, f_size(&Fil) & ~(DWORD)(LOG_RECORD_SIZE - 1));
+#else
+	/* ustawienie wskanika w pliku na jego kocu */
+	return f_lseek(&Fil, f_size(&Fil));
+#endif
+}
+
+
+
+/**
+ * Zamyka plik z logiem otwarty funkcj @see OpenLog i w razie potrzeby uniewania tablic CLMT.
+ * @return Kod zwrcony przez funkcj f_close.
+ */
+FRESULT CloseLog(void)
+{
+	FRESULT res = f_close(&Fil);
+	
+	/* obiekt pliku nie jest ju uywany, nawet jeli zamknicie si nie powiodo */
+	Fil.fs = 0;
+	
+	/* FatFS wycza tryb szybkiego przesuwania wskanika, gdy plik zostanie rozszerzony o nowy fragment - tablica CLMT jest wtedy nieaktualna */
+	if(clmt[0] > 1 && (!Fil.cltbl || res != FR_OK || device_flags.sd_communication_error))
+		clmt[0] = 0;
+	
+	return res;
+}
+
+
+
+/**
+ * Zapewnia, e w obiekcie Fil otwarty jest plik z logiem waciwy dla daty zapisanej w rekordzie.<br>
+ * Jeli otwarty jest plik z innego dnia (miesica), zamyka go i otwiera waciwy, korzystajc z pooenia wpisu katalogowego
+ * pliku utworzonego zawczasu przez funkcj @see PrepareNextLog
+ * @param record Rekord z bufora, ktry ma zosta zapisany.
+ * @return FR_OK jeli do pliku mona dopisa rekord, w przeciwnym razie kod bdu zwrcony przez FatFS.
+ */
+FRESULT SelectLog(const char *record)
+{
+	/* nazwa pliku dla daty rekordu */
+	char name[13];
+	FRESULT res;
+	
+	LogName(name, record);
+	
+	/* waciwy plik jest ju otwarty */
+	if(Fil.fs && !strcmp(name, log_name))
+		return FR_OK;
+	
+	/* zamknicie pliku z poprzedniego dnia (miesica) */
+	if(Fil.fs && (res = CloseLog()) != FR_OK)
+		return res;
+	
+	/* zapamitane pooenie wpisu katalogowego dotyczy innego pliku */
+	if(strcmp(name, log_name))
+	{
+		strcpy(log_name, name);
+		
+#if LOG_ROTATION
+		/* plik utworzony zawczasu - otwarcie go nie wymaga przeszukiwania katalogu */
+		if(next_loc.sect && !strcmp(name, next_name))
+		{
+			log_loc = next_loc;
+			next_loc.sect = 0;
+		}
+		else
+#endif
+			log_loc.sect = 0;
+	}
+	
+	return OpenLog();
+}
+
+
+
+#if LOG_ROTATION
+/**
+ * Tworzy zawczasu plik z logiem na kolejny dzie (miesic) i zapamituje pooenie jego wpisu katalogowego.<br>
+ * Dziki temu pierwszy zapis po zmianie daty kosztuje tyle samo, co zwyke dopisanie rekordw do pliku.<br>
+ * Wywoywana w ptli gwnej programu, gdy w buforze nie czekaj adne rekordy.
+ */
+void PrepareNextLog(void)
+{
+	/* aby operacja nie zostaa przerwana zapisem bufora */
+	cli();
+	
+	log_prepare = 0;
+	
+	if(f_mount(&FatFs, "", 1) == FR_OK)
+	{
+		/* utworzenie pustego pliku (jeli ju istnieje, zostanie jedynie otwarty) */
+		if(f_openloc(&Fil, next_name, FA_WRITE | FA_OPEN_ALWAYS, &next_loc) == FR_OK && f_close(&Fil) != FR_OK)
+			next_loc.sect = 0;
+		
+		/* odmontowanie systemu plikw (bez punktu kontrolnego) */
+		f_mount(NULL, "", 0);
+	}
+	
+	/* ponowne wczenie przerwa, jeli jest to moliwe */
+	if(device_flags.interrupts)
+		sei();
+}
+#endif
+
+
+
+/**
+ * Tworzy rekord tekstowy o zdarzeniu, jako napis o formacie "YY-MM-DD HH:ii:SS.mmm c" z numerem drzwi i liczb zmian stanu drzwi na kocu.
+ * @param record Bufor (co najmniej RECORD_SIZE znakw).
+ * @param t Data i czas zdarzenia.
+ * @param event Kod zdarzenia.
+ * @param channel Numer drzwi (0 dla zdarze niezwizanych z drzwiami).
+ * @param count Liczba zmian stanu drzwi (0 dla zwykych rekordw).
+ */
+void FormatRecord(char *record, const time *t, char event, uint8_t channel, uint8_t count)
+{
+	sprintf_P(record, PSTR(RECORD_FORMAT), t->years, t->months, t->days, t->hours, t->minutes, t->seconds, t->milliseconds, event, channel, count);
+}
+
+
+
+#if LOG_FORMAT
+/**
+ * Odczytuje dat i czas (bez milisekund) z rekordu z bufora lub z rekordu z now dat i czasem ustawionymi w RTC.
+ * @param t Struktura, do ktrej zapisane zostan data i czas (pole milliseconds nie jest zmieniane).
+ * @param record Rekord zaczynajcy si od daty i czasu w formacie "YY-MM-DD HH:ii:SS".
+ */
+void RecordTime(time *t, const char *record)
+{
+	t->years   = (record[0] - '0') * 10 + record[1] - '0';
+	t->months  = (record[3] - '0') * 10 + record[4] - '0';
+	t->days    = (record[6] - '0') * 10 + record[7] - '0';
+	t->hours   = (record[9] - '0') * 10 + record[10] - '0';
+	t->minutes = (record[12] - '0') * 10 + record[13] - '0';
+	t->seconds = (record[15] - '0') * 10 + record[16] - '0';
+}
+#endif
+
+
+
+/**
+ * Tworzy wiersz pliku z logiem dla rekordu z bufora: dat i czas z milisekundami, numer drzwi (np. "door 3 "), nazw zdarzenia,
+ * liczb zmian stanu drzwi (np. " after 57 toggles", tylko w podsumowaniu serii zmian) oraz znaki nowej linii (CRLF).<br>
+ * W binarnym pliku z logiem (LOG_FORMAT > 0) wierszem jest rekord o rozmiarze LOG_RECORD_SIZE (patrz @see SpillPack).
+ * @param line Bufor (co najmniej 56 znakw), do ktrego zapisany zostanie wiersz.
+ * @param record Rekord z bufora.
+ * @return Dugo wiersza (w bajtach).
+ */
+UINT RecordLine(char *line, const char *record)
+{
+#if LOG_FORMAT
+	/* data i czas zdarzenia */
+	time t;
+	
+	RecordTime(&t, record);
+	t.milliseconds = (record[18] - '0') * 100 + (record[19] - '0') * 10 + record[20] - '0';
+	
+	SpillPack((uint8_t *)line, &t, record[RECORD_CODE], record[RECORD_CHANNEL], record[RECORD_COUNT]);
+	
+	return LOG_RECORD_SIZE;
+#else
+	/* dugo wiersza bez znakw nowej linii */
+	uint8_t length;
+	
+	/* skopiowanie daty, czasu z milisekundami i spacji, z uwzgldnieniem znaku \0 na potrzeby funkcji strcat */
+	strncpy(line, record, RECORD_CODE);
+	line[RECORD_CODE] = '\0';
+	
+	/* numer drzwi, ktrych dotyczy zdarzenie */
+	if(record[RECORD_CHANNEL])
+	{
+		strcat_P(line, PSTR("door "));
+		
+		length = strlen(line);
+		line[length]     = '0' + record[RECORD_CHANNEL];
+		line[length + 1] = ' ';
+		line[length + 2] = '\0';
+	}
+	
+	/* skopiowanie nazwy zdarzenia z pamici programu */
+	strcat_P(line, (PGM_P)pgm_read_word(&events_names[(int)record[RECORD_CODE]]));
+	
+	/* liczba zmian stanu drzwi, ktre zoyy si na podsumowanie serii */
+	if(record[RECORD_COUNT])
+		sprintf_P(line + strlen(line), PSTR(" after %u toggles"), (uint8_t)record[RECORD_COUNT]);
+	
+	/* dodanie znaku nowej linii (CRLF) na kocu */
+	length = strlen(line);
+	line[length]     = '\r';
+	line[length + 1] = '\n';
+	line[length + 2] = '\0';
+	
+	return length + 2;
+#endif
+}
+
+
+
+/**
+ * Tworzy wiersz pliku z logiem z now dat i czasem ustawionymi w RTC (bez milisekund), nastpujcy po rekordzie o zdarzeniu 4.<br>
+ * W binarnym pliku z logiem jest to rekord o kodzie SPILL_NEW_DATE.
+ * @param line Bufor (co najmniej RECORD_SIZE znakw), do ktrego zapisany zostanie wiersz.
+ * @param record Rekord z now dat i czasem w formacie "YY-MM-DD HH:ii:SS" (w pliku tekstowym dopisywane s do niego znaki CRLF).
+ * @return Dugo wiersza (w bajtach).
+ */
+UINT DateLine(char *line, char *record)
+{
+#if LOG_FORMAT
+	/* nowa data i czas */
+	time t;
+	
+	RecordTime(&t, record);
+	t.milliseconds = 0;
+	
+	SpillPack((uint8_t *)line, &t, SPILL_NEW_DATE, 0, 0);
+	
+	return LOG_RECORD_SIZE;
+#else
+	/* dodanie znaku nowej linii (CRLF) na kocu */
+	record[17] = '\r';
+	record[18] = '\n';
+	record[19] = '\0';
+	
+	strcpy(line, record);
+	
+	return 19;
+#endif
+}
+
+
+
+/**
+ * Odczytuje ustawienia z pliku konfiguracyjnego na zamontowanej karcie SD (patrz @see ConfigLoad) i stosuje je w sterowaniu diodami i prbkowaniu kontaktronw.<br>
+ * Ustawienia flush i idle obowizuj od kolejnego zdarzenia. Ustawienia buffer i high obowizuj od razu tylko przy pustym aktywnym banku bufora,
+ * a w przeciwnym razie - od najbliszej zamiany bankw, aby obniony prg nie odci rekordw zapisanych ju w aktywnym banku
+ * (np. w trakcie zapisu w tle, patrz @see SaveBuffer).
+ */
+void LoadConfig(void)
+{
+	/* progi bufora obowizujce przed odczytem pliku */
+	uint8_t buffer = settings.buffer, high = settings.high;
+	uint8_t sreg;
+	FRESULT res = ConfigLoad(&Fil);
+	
+	/* obiekt pliku nie jest ju uywany */
+	Fil.fs = 0;
+	
+	/* nowe progi bufora czekaj na zamian bankw, do tego czasu obowizuj dotychczasowe */
+	sreg = SREG;
+	cli();
+	
+	next_buffer = settings.buffer;
+	next_high = settings.high;
+	
+	if(buffer_index)
+	{
+		settings.buffer = buffer;
+		settings.high = high;
+	}
+	
+	SREG = sreg;
+	
+	/* bd odczytu - ponowna prba przy kolejnym zapisie bufora */
+	if(res != FR_OK && res != FR_NO_FILE)
+		return;
+	
+	config_loaded = 1;
+	
+	/* nazwa pliku z logiem moga si zmieni - pooenie wpisu katalogowego zostanie wyznaczone od nowa */
+	log_name[0] = '\0';
+	
+	DoorDebounce(settings.debounce);
+	LedSpeed(settings.blink);
+}
+
+
+
+/**
+ * Zamienia banki bufora: aktywny bank (z nowymi rekordami) staje si nieaktywnym, przeznaczonym do zapisu na kart SD, a pusty bank - aktywnym.<br>
+ * Nowy aktywny bank jest pusty, wic od tej chwili obowizuj progi bufora odczytane z pliku konfiguracyjnego (patrz @see LoadConfig).<br>
+ * Wywoywana tylko wtedy, gdy nieaktywny bank jest pusty. Zamiana trwa kilka cykli i przebiega przy wyczonych przerwaniach.
+ */
+void SwapBanks(void)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	
+	buffer_bank ^= 1;
+	drain_count = buffer_index;
+	buffer_index = 0;
+	
+	settings.buffer = next_buffer;
+	settings.high = next_high;
+	
+	SREG = sreg;
+}
+
+
+
+/* zdefiniowana dalej, wraz z pozostaymi funkcjami rejestrujcymi zmiany stanu drzwi */
+void DoorEvents(void);
+
+
+
+/**
+ * Zapisuje na kart SD rekordy z nieaktywnego banku bufora (patrz @see SwapBanks), a po bezbdnym zapisie - rekordy z pamici EEPROM.<br>
+ * Rekordy, ktrych nie udao si zapisa, pozostaj w nieaktywnym banku i s zapisywane przy kolejnym wywoaniu, przed zamian bankw.<br>
+ * W trakcie zapisu ustawiona jest flaga flush_busy - procedury obsugi przerwa nie korzystaj wtedy z karty SD, a nowe rekordy trafiaj do aktywnego banku.
+ * Przy zapisie w tle zmiany stanu drzwi rejestrowane s pomidzy kolejnymi rekordami (patrz @see DoorEvents).
  * W razie potrzeby ustawia flag braku karty SD lub flag bdu komunikacji z kart SD.
+ * @param background 1 - zapis przebiega przy wczonych przerwaniach (wywoanie z ptli gwnej programu), 0 - przy wyczonych przerwaniach
  */
-void SaveBuffer()
+void SaveBuffer(uint8_t background)
 {
 	/* zmienna iteracyjna */
 	uint8_t i = 0;
 	/* przechowuje ilo bajtw zapisanych przez funkcj f_write (uywana rwnie jako zmienna tymczasowa) */
 	UINT bw = 0;
 	/* tymczasowy bufor na dane do zapisania na karcie SD */
-	char temp[38] = {'\0',};
+	char temp[56] = {'\0',};
+	/* rekord z bufora lub z pamici EEPROM w formacie tekstowym */
+	char record[RECORD_SIZE];
+	/* data, czas, kod zdarzenia, numer drzwi i liczba zmian stanu drzwi rekordu z bufora lub z pamici EEPROM */
+	time spilled;
+	uint8_t code, channel, count;
+	/* zapisywany bank bufora */
+	uint8_t (*bank)[SPILL_RECORD_SIZE];
+	/* numer przebiegu zapisu bankw */
+	uint8_t pass;
 	
-	/* aby zapis danych nie zosta przerwany */
+	/* od tej chwili procedury obsugi przerwa nie korzystaj z karty SD */
 	cli();
+	flush_busy = 1;
+	
+	/* zamiana bankw przebiega przy wyczonych przerwaniach, wic zapis moe by przerywany zdarzeniami z drzwi, przyciskw i RTC */
+	if(background)
+		sei();
 	
 	/* prba zamontowania systemu plikw karty SD */
 	switch(f_mount(&FatFs, "", 1))
 	{
 		/* jeli karta zgasza swoj niegotowo, po 1 sekundzie nastpuje druga prba zamontowania systemu plikw */
 		case FR_NOT_READY:
-			_delay_ms(1000);
+			for(i = 0; i < 100; ++i)
+			{
+				_delay_ms(10);
+				
+				/* zmiany stanu drzwi nie czekaj na kolejn prb */
+				if(background)
+					DoorEvents();
+			}
 			
 			/* jeli wci nie da si zamontowa systemu plikw, naley powiadomi uytkownika i zakoczy dziaanie funkcji */
 			if(f_mount(&FatFs, "", 1) != FR_OK)
@@ -127,126 +782,150 @@ void SaveBuffer()
 				if(!device_flags.no_sd_card)
 					device_flags.sd_communication_error = device_flags.no_sd_card = 1;
 				
+				/* plik konfiguracyjny zostanie odczytany z karty woonej w jej miejsce */
+				config_loaded = 0;
+				
 				/* sekwencja migni diody czerwonej, sygnalizujca uytkownikowi niegotowo karty SD */
-				BlinkRed(5, 100, 100);
+				LedPattern(LED_RED, 5, 100, 100);
 				
 				break;
 			}
 		
 		/* jeli pomylnie udao si zamontowa system FAT, nastpuje przejcie do zapisu danych */
 		case FR_OK:
-			/* prba otwarcia/utworzenia pliku, do ktrego zapisywane s informacje o wykrytych przez urzdzenie zdarzeniach */
-			if(f_open(&Fil, "DoorLog.txt", FA_WRITE | FA_OPEN_ALWAYS) == FR_OK)
+			/* aden plik z logiem nie jest jeszcze otwarty - zostanie otwarty przy zapisie pierwszego rekordu */
+			Fil.fs = 0;
+			
+			/* owiecenie diody LED2 (czerwonej) na czas zapisu */
+			LedBusy(1);
+	
+			/* najpierw zapisywane s rekordy pozostae w nieaktywnym banku po nieudanym zapisie, a potem rekordy z aktywnego banku
+			 * (w drugim przebiegu - rwnie rekordy, ktre trafiy do aktywnego banku w trakcie zapisu) */
+			for(pass = 0; pass < 2 && !device_flags.sd_communication_error; ++pass)
 			{
-				/* prba ustawienia wskanika w pliku na jego kocu */
-				if(f_lseek(&Fil, f_size(&Fil)) == FR_OK)
+				if(!drain_count)
+					SwapBanks();
+				
+				bank = buffer[buffer_bank ^ 1];
+				
+				/* zapisanie na karcie SD rekordw z nieaktywnego banku */
+				for(i = 0; i < drain_count; ++i)
 				{
-					/* owiecenie diody LED2 (czerwonej) */
-					PORTD |= 1 << PD6;
-	
-					/* zapisanie na karcie SD rekordw z bufora */
-					for(i = 0; i < buffer_index; ++i)
-					{
-						/* skopiowanie daty, czasu i spacji, z uwzgldnieniem znaku \0 na potrzeby funkcji strcat */
-						strncpy(temp, buffer[i], 18);
-						temp[18] = '\0';
+					/* zmiany stanu drzwi wykryte w trakcie zapisu trafiaj do aktywnego banku */
+					if(background)
+						DoorEvents();
 					
-						/* skopiowanie nazwy zdarzenia */
-						strcat(temp, events_names[(int)buffer[i][18]]);
-							
-						/* dodanie znaku nowej linii (CRLF) na kocu, z uwzgldnieniem znaku \0 na potrzeby funkcji f_write */
-						bw = strlen(temp);
-						temp[bw]     = '\r';
-						temp[bw + 1] = '\n';
-						temp[bw + 2] = '\0';
-						
+					/* rekord w formacie tekstowym i utworzony na jego podstawie wiersz pliku z logiem */
+					SpillUnpack(bank[i], &spilled, &code, &channel, &count);
+					FormatRecord(record, &spilled, code, channel, count);
+					bw = RecordLine(temp, record);
 					
-						/* prba zapisu rekordu informacyjnego do pliku */
-						if(f_write(&Fil, temp, strlen(temp), &bw) == FR_OK)
-						{
-							/* jeli zapisywany rekord dotyczy zmiany ustawie daty i czasu w RTC, nastpny rekord w buforze zawiera now dat i czas */
-							if(buffer[i][18] == 4)
-							{
-								++i;
-						
-								/* dodanie znaku nowej linii (CRLF) na kocu */
-								buffer[i][17] = '\r';
-								buffer[i][18] = '\n';
-									
-								/* jeli prba zapisu tych danych do pliku si nie powiedzie */
-								if(f_write(&Fil, buffer[i], strlen(buffer[i]), &bw) != FR_OK)
-								{
-									/* ustawienie flagi bdu komunikacji z kart SD */
-									device_flags.sd_communication_error = 1;
-										
-									/* jeli zapisano bezbdnie co najmniej 1 element */
-									if(i > 0)
-									{
-										/* przesuwanie zawartoci bufora do jego pocztku */
-										bw = 0;
-										
-										for(; i < buffer_index; ++i)
-										{
-											strcpy(buffer[bw], buffer[i]);
-											++bw;
-										}
-										
-										/* aktualizowanie wskanika bufora */
-										buffer_index = bw + 1;
-									}
-										
-									break;
-								}
-							}
-						}
-						else
+					/* prba otwarcia pliku waciwego dla daty rekordu i zapisu do niego rekordu informacyjnego */
+					if(SelectLog(record) == FR_OK && f_write(&Fil, temp, bw, &bw) == FR_OK)
+					{
+						/* jeli zapisywany rekord dotyczy zmiany ustawie daty i czasu w RTC, nastpny rekord w banku (o kodzie SPILL_NEW_DATE)
+						 * zawiera now dat i czas (trafia on do tego samego pliku, co rekord o zmianie ustawie) */
+						if(code == 4 && i + 1 < drain_count)
 						{
-							/* ustawienie flagi bdu komunikacji z kart SD */
-							device_flags.sd_communication_error = 1;
-								
-							/* jeli zapisano bezbdnie co najmniej 1 element */
-							if(i > 0)
+							++i;
+							
+							/* utworzenie wiersza z now dat i czasem (zapisanymi bez milisekund) */
+							SpillUnpack(bank[i], &spilled, &code, &channel, &count);
+							FormatRecord(record, &spilled, code, channel, count);
+							bw = DateLine(temp, record);
+							
+							/* jeli prba zapisu tych danych do pliku si nie powiedzie, oba rekordy zostan zapisane ponownie */
+							if(f_write(&Fil, temp, bw, &bw) != FR_OK)
 							{
-								/* przesuwanie zawartoci bufora do jego pocztku */
-								bw = 0;
+								--i;
 								
-								for(; i < buffer_index; ++i)
-								{
-									strcpy(buffer[bw], buffer[i]);
-									++bw;
-								}
+								/* ustawienie flagi bdu komunikacji z kart SD */
+								device_flags.sd_communication_error = 1;
 								
-								/* aktualizowanie wskanika bufora */
-								buffer_index = bw + 1;
+								break;
 							}
-								
-							break;
 						}
 					}
+					else
+					{
+						/* ustawienie flagi bdu komunikacji z kart SD */
+						device_flags.sd_communication_error = 1;
+						
+						break;
+					}
+				}
+				
+				/* przesunicie niezapisanych rekordw na pocztek nieaktywnego banku (nie jest on uywany przez procedury obsugi przerwa) */
+				if(i)
+				{
+					drain_count -= i;
+					memmove(bank, bank + i, drain_count * SPILL_RECORD_SIZE);
+				}
+			}
 	
-					/* zgaszenie diody LED2 (czerwonej) */
-					PORTD &= 191;
-					
-					/* jeli nie byo bdu, cay bufor na pewno zosta zapisany na karcie SD */
-					if(!device_flags.sd_communication_error)
-						/* ustawienie wskanika bufora na pocztek */
-						buffer_index = 0;
+			/* zgaszenie diody LED2 (czerwonej) */
+			LedBusy(0);
+			
+			/* przepisanie na kart SD rekordw z pamici EEPROM (s one nowsze ni rekordy z bufora, dlatego zapisywane s dopiero po nich)
+			 * rekord usuwany jest z pamici EEPROM dopiero po zapisaniu go na karcie SD */
+			while(!device_flags.sd_communication_error && SpillPeek(&spilled, &code, &channel, &count))
+			{
+				if(background)
+					DoorEvents();
+				
+				/* rekord w formacie bufora, na podstawie ktrego wybierany jest plik z logiem */
+				FormatRecord(record, &spilled, code, channel, count);
+				
+				/* nowa data i czas ustawione w RTC zapisywane s bez milisekund i trafiaj do tego samego pliku, co poprzedzajcy je rekord o zmianie ustawie */
+				if(code == SPILL_NEW_DATE)
+				{
+					bw = DateLine(temp, record);
 					
-					/* prba zamknicia pliku */
-					if(f_close(&Fil) != FR_OK)
+					if((Fil.fs || SelectLog(record) == FR_OK) && f_write(&Fil, temp, bw, &bw) == FR_OK)
+						SpillDrop();
+					else
 						device_flags.sd_communication_error = 1;
 				}
 				else
-					/* ustawienie flagi bdu komunikacji z kart SD */
-					device_flags.sd_communication_error = 1;
+				{
+					bw = RecordLine(temp, record);
+					
+					if(SelectLog(record) == FR_OK && f_write(&Fil, temp, bw, &bw) == FR_OK)
+						SpillDrop();
+					else
+						device_flags.sd_communication_error = 1;
+				}
 			}
-   			else
-   				/* ustawienie flagi bdu komunikacji z kart SD */
+			
+			/* prba zamknicia ostatniego pliku z logiem */
+			if(Fil.fs && CloseLog() != FR_OK)
 				device_flags.sd_communication_error = 1;
+			
+			/* odczyt pliku konfiguracyjnego z nowo zamontowanej karty, gdy bufor jest ju pusty */
+			if(!config_loaded && !device_flags.sd_communication_error)
+				LoadConfig();
+			
+#if LOG_ROTATION
+			/* plik na kolejny dzie (miesic) zostanie utworzony w ptli gwnej, jeli jeszcze nie istnieje */
+			if(log_name[0])
+			{
+				strcpy(temp, log_name);
+				NextLogName(temp);
+				
+				if(strcmp(temp, next_name))
+				{
+					strcpy(next_name, temp);
+					next_loc.sect = 0;
+				}
+				
+				if(!next_loc.sect)
+					log_prepare = 1;
+			}
+#endif
 
 			/* bd, ktry wystpi podczas komunikacji z kart SD, zgaszany jest uytkownikowi poprzez odpowiedni sekwencj migni czerwonej diody */
 			if(device_flags.sd_communication_error)
-				BlinkRed(3, 200, 100);
+				LedPattern(LED_RED, 3, 200, 100);
 			
 			/* wyczyszczenie flagi braku karty SD (dla odrnienia, e w tej funkcji nastpi bd komunikacji z kart, a nie wykrycie braku karty) */
 			device_flags.no_sd_card = 0;
@@ -258,15 +937,22 @@ void SaveBuffer()
 			/* ustawienie flagi braku karty SD i flagi bdu komunikacji z kart (dla odrnienia, e brak karty zosta wykryty w tej funkcji) */
 			if(!device_flags.no_sd_card)
 				device_flags.sd_communication_error = device_flags.no_sd_card = 1;
+			
+			/* plik konfiguracyjny zostanie odczytany z karty woonej w jej miejsce */
+			config_loaded = 0;
 	}
 	
-	/* prba odmontowania systemu plikw */
-	if(f_mount(NULL, "", 1) != FR_OK)
+	/* prba odmontowania systemu plikw (bez punktu kontrolnego - aktualizacja kopii tablicy FAT i sektora FSINFO odkadana jest do kolejnych zapisw) */
+	if(f_mount(NULL, "", 0) != FR_OK)
 	{
 		/* sekwencja migni diod, sygnalizujca uytkownikowi bd podczas prby odmontowania systemu plikw */
-		BlinkBoth(3, 200, 100);
+		LedPattern(LED_BOTH, 3, 200, 100);
 	}
 	
+	/* zakoczenie zapisu (wywoujcy moe operowa na buforze bez ryzyka przerwania) */
+	cli();
+	flush_busy = 0;
+	
 	/* ponowne wczenie przerwa, jeli jest to moliwe */
 	if(device_flags.interrupts)
 		sei();
@@ -275,21 +961,45 @@ void SaveBuffer()
 
 
 /**
- * Zapisuje we wskazywanym przez 'buffer_index' elemencie bufora rekord o zarejestrowanym przez urzdzenie zdarzeniu.<br>
+ * Uruchamia odliczanie settings.flush sekund przez timer RTC (po jego upywie wyjcie INT zegara wywoa przerwanie INT0), jeli nie zostao ju uruchomione.<br>
+ * Odliczanie rozpoczyna najstarszy niezapisany rekord, dlatego kolejne zdarzenia nie odsuwaj zapisu bufora.
+ * Odliczanie nie zaley od zegara procesora i trwa rwnie wtedy, gdy procesor jest upiony.
+ */
+void FlushArm(void)
+{
+	/* jeli RTC nie przyj ustawie, kolejna prba nastpi przy nastpnym zdarzeniu */
+	if(!flush_armed && RtcStartTimer(settings.flush) == TWI_OK)
+		flush_armed = 1;
+}
+
+
+
+/**
+ * Zatrzymuje timer RTC po oprnieniu bufora i pamici EEPROM.
+ */
+void FlushStop(void)
+{
+	RtcStopTimer();
+	
+	flush_armed = 0;
+}
+
+
+
+/**
+ * Zapisuje we wskazywanym przez 'buffer_index' elemencie bufora rekord o zarejestrowanym przez urzdzenie zdarzeniu, z dat i czasem ze zmiennej now.<br>
  * Jeeli bufor jest zapeniony, wymusza zapisanie jego zawartoci na karcie SD.<br>
  * W razie potrzeby ustawia flagi braku karty SD i zapenienia bufora.
  * @param event Kod reprezentujcy rodzaj zdarzenia zarejestrowany przez urzdzenie.<br>W dokumentacji urzdzenia znajduje si lista zdarze wraz z kodami.
+ * @param channel Numer drzwi, ktrych dotyczy zdarzenie (0 dla zdarze niezwizanych z drzwiami).
+ * @param count Liczba zmian stanu drzwi (0 dla zwykych rekordw, patrz @see FlapEnd).
  */
-void SaveEvent(char event)
+void StoreEvent(char event, uint8_t channel, uint8_t count)
 {
-	/* pobranie aktualnej daty i czasu z RTC */
-	RtcGetTime(&now);
-	
-	/* jeli bufor jest ju peny, naley wymusi zapis jego zawartoci na kart SD */
-	if(buffer_index >= BUFFER_SIZE)
+	/* jeli bufor jest ju peny, naley wymusi zapis jego zawartoci na kart SD
+	 * (jeli zapis wanie trwa w ptli gwnej programu, rekord trafia do pamici EEPROM) */
+	if(buffer_index >= settings.buffer && !flush_busy)
 	{
-		buffer_index = BUFFER_SIZE;
-		
 		/* jeli w trakcie operacji zapisu danych z bufora na kart SD wystpi bd,
 		 * urzdzenie zasygnalizuje to jako zapenienie bufora przy braku karty SD */
 		device_flags.buffer_full = 1;
@@ -298,16 +1008,16 @@ void SaveEvent(char event)
 		 * jeli wczeniej zgoszono brak karty, w razie jej wykrycia naley zapisa informacj o tym w buforze */
 		if(device_flags.no_sd_card)
 		{
-			SaveBuffer();
+			SaveBuffer(0);
 			
 			if(!device_flags.no_sd_card)
-				SaveEvent(5);
+				StoreEvent(5, 0, 0);
 		}
 		else
-			SaveBuffer();
+			SaveBuffer(0);
 		
 		/* jeli wystpi bd zapisu, a bufor jest peny, naley uniemoliwi zapisywanie kolejnych informacji do bufora, aby nie wyj poza zakres tej tablicy */
-		if(buffer_index >= BUFFER_SIZE)
+		if(buffer_index >= settings.buffer)
 			device_flags.no_sd_card = 1;
 		else
 		{
@@ -318,13 +1028,12 @@ void SaveEvent(char event)
 			else if(device_flags.no_sd_card)
 			{
 				/* zapisywanie w buforze rekordu informujcego o braku karty SD */
-				sprintf(buffer[buffer_index], "%02d-%02d-%02d %02d:%02d:%02d %c", now.years, now.months, now.days,
-				now.hours, now.minutes, now.seconds, 3);
+				SpillPack(buffer[buffer_bank][buffer_index], &now, 3, 0, 0);
 				
 				++buffer_index;
 				
 				/* jeli bufor wci nie jest peny, urzdzenie informowa ma tylko o braku karty SD */
-				if(buffer_index < BUFFER_SIZE)
+				if(buffer_index < settings.buffer)
 					device_flags.buffer_full = 0;
 			}
 		}
@@ -333,102 +1042,263 @@ void SaveEvent(char event)
 		device_flags.sd_communication_error = 0;
 	}
 	
-	/* jeli bufor jest peny i brak karty SD, nastpuje utrata informacji */
-	if(!device_flags.buffer_full || !device_flags.no_sd_card)
+	/* jeli w pamici EEPROM czekaj starsze rekordy, nowy rekord rwnie trafia do niej (aby zachowa kolejno zdarze na karcie SD) */
+	if(!SpillCount() && buffer_index < settings.buffer && (!device_flags.buffer_full || !device_flags.no_sd_card))
 	{
-		/* sprawdzenie obecnoci moliwego do zamontowania systemu plikw */
-		if(f_mount(&FatFs, "", 1) != FR_OK)
+		/* sprawdzenie obecnoci moliwego do zamontowania systemu plikw (pomijane w trakcie zapisu - karta jest wtedy uywana przez funkcj SaveBuffer) */
+		if(!flush_busy && f_mount(&FatFs, "", 1) != FR_OK)
 		{
 			/* jeli ju wczeniej stwierdzono brak karty SD, nie ma sensu dublowa informacji w buforze */
 			if(!device_flags.no_sd_card)
 			{
 				/* zapisywanie w buforze rekordu informujcego o braku karty SD */
-				sprintf(buffer[buffer_index], "%02d-%02d-%02d %02d:%02d:%02d %c", now.years, now.months, now.days,
-				now.hours, now.minutes, now.seconds, 3);
+				SpillPack(buffer[buffer_bank][buffer_index], &now, 3, 0, 0);
 		
 				++buffer_index;
 			}
 			
-			/* ustawienie flagi braku karty SD */
+			/* ustawienie flagi braku karty SD (plik konfiguracyjny zostanie odczytany z karty woonej w jej miejsce) */
 			device_flags.no_sd_card = 1;
+			config_loaded = 0;
 		
 			/* zapenienie bufora przy braku karty SD */
-			if(buffer_index >= BUFFER_SIZE)
-			{
-				buffer_index = BUFFER_SIZE;
-				
+			if(buffer_index >= settings.buffer)
 				device_flags.buffer_full = 1;
-			}
 			else
 				device_flags.buffer_full = 0;
 		}
-		else
+		else if(!flush_busy)
 		{
-			/* prba odmontowania systemu plikw */
-			if(f_mount(NULL, "", 1) != FR_OK)
+			/* prba odmontowania systemu plikw (bez punktu kontrolnego) */
+			if(f_mount(NULL, "", 0) != FR_OK)
 			{
 				/* sekwencja migni diod, sygnalizujca uytkownikowi bd podczas prby odmontowania systemu plikw */
-				BlinkBoth(3, 200, 100);
-				
-				/* _delay_ms wycza przerwania - ponowne wczenie przerwa, jeli jest to moliwe */
-				if(device_flags.interrupts)
-					sei();
+				LedPattern(LED_BOTH, 3, 200, 100);
 			}
 		
 			/* wyczyszczenie flagi */
 			device_flags.no_sd_card = 0;
 		}
 	
-		/* jeli bufor jest peny i brak karty SD, nastpuje utrata informacji */
+		/* jeli bufor jest peny i brak karty SD, rekord trafia do pamici EEPROM */
 		if(!device_flags.buffer_full || !device_flags.no_sd_card)
 		{
-			/* zapisywanie w buforze daty i czasu z RTC oraz symbolu zdarzenia jako napis o formacie "YY-MM-DD HH:ii:SS c" */
-			sprintf(buffer[buffer_index], "%02d-%02d-%02d %02d:%02d:%02d %c", now.years, now.months, now.days,
-				now.hours, now.minutes, now.seconds, event);
-	
-			/* przy zegarze taktujcym z czst. 1 MHz, z preskalerem 1024, w cigu 30 sekund licznik naliczy prawie 29297,
-			 * dlatego ustawiem tutaj warto 65535 (max) - 29296, aby przy 29297-mej inkrementacji nastpio przepenienie licznika, co wywoa przerwanie */
-			TCNT1 = 36239;
+			/* zapisywanie w buforze daty i czasu z RTC, symbolu zdarzenia, numeru drzwi i liczby zmian stanu drzwi */
+			SpillPack(buffer[buffer_bank][buffer_index], &now, event, channel, count);
 	
-			/* wczenie Timera/Countera 1, ustawienie jego preskalera na 1024 */
-			TCCR1B = 1 << CS12 | 1 << CS10;
+			/* rozpoczcie odliczania czasu do zapisu bufora (jeli jest to pierwszy rekord w buforze) */
+			FlushArm();
 	
 			++buffer_index;
+			
+			/* po osigniciu progu zapenienia bufor zapisywany jest w ptli gwnej programu, zanim wymuszony zostanie zapis penego bufora */
+			if(buffer_index >= settings.high && !device_flags.no_sd_card)
+				flush_request = 1;
+			
+			return;
 		}
 	}
+	
+	/* bufor jest peny i brak karty SD - rekord zapisywany jest w pamici EEPROM (utrata informacji nastpuje dopiero po jej zapenieniu) */
+	if(SpillPut(&now, event, channel, count))
+		FlushArm();
 }
 
 
 
 /**
- * Obsuga przerwa z kontaktronu (PD3).<br>
- * Rejestrowanie zdarzenia otwarcia/zamknicia drzwi.
- * @param INT1_vect Wektor przerwania zewntrznego INT1.
+ * Pobiera biec dat i czas z RTC i zapisuje rekord o zdarzeniu niezwizanym z drzwiami (patrz @see StoreEvent).
+ * @param event Kod reprezentujcy rodzaj zdarzenia zarejestrowany przez urzdzenie.
  */
-ISR(INT1_vect)
+void SaveEvent(char event)
 {
-	/* zablokowanie funkcji SaveBuffer moliwoci wczania przerwa */
-	device_flags.interrupts = 0;
+	/* pobranie aktualnej daty i czasu z RTC */
+	RtcGetTime(&now);
+	
+	StoreEvent(event, 0, 0);
+}
+
+
+
+/**
+ * Wyszukuje seri zmian stanu drzwi, ktra jest w trakcie zliczania.
+ * @param channel Numer drzwi (0 - wyszukanie nieuywanego elementu tablicy flap_runs).
+ * @return Wskanik na seri lub NULL, jeli nie znaleziono.
+ */
+flap_run *FlapFind(uint8_t channel)
+{
+	/* zmienna iteracyjna */
+	uint8_t i;
+	
+	for(i = 0; i < FLAP_RUNS; ++i)
+		if(flap_runs[i].channel == channel)
+			return &flap_runs[i];
+	
+	return NULL;
+}
+
+
+
+/**
+ * Koczy zliczanie serii zmian stanu drzwi i zapisuje jej podsumowanie jako dwa rekordy: zdarzenie 6 (flapping) z dat i czasem pierwszej zmiany
+ * oraz otwarcie/zamknicie drzwi (stan kocowy) z dat i czasem ostatniej zmiany i liczb zmian.<br>
+ * Wywoywana przy wyczonych przerwaniach.
+ * @param run Seria zmian stanu drzwi.
+ */
+void FlapEnd(flap_run *run)
+{
+	/* data i czas, ktre zostan przywrcone po zapisaniu podsumowania */
+	time saved = now;
+	
+	now = run->first;
+	StoreEvent(6, run->channel, 0);
+	
+	now = run->last;
+	StoreEvent(run->event, run->channel, run->toggles);
+	
+	now = saved;
+	run->channel = 0;
+}
+
+
+
+/**
+ * Odmierza okna zliczania zmian stanu drzwi i koczy serie zmian drzwi, ktre nie zmieniy stanu przez FLAP_WINDOW sekund.<br>
+ * Wywoywana w ptli gwnej programu raz na sekund.
+ */
+void FlapCheck(void)
+{
+	/* zmienna iteracyjna */
+	uint8_t i;
+	flap_run *run;
+	
+	++flap_clock;
+	
+	for(i = 0; i < 8; ++i)
+	{
+		if(!flap_count[i] || (uint8_t)(flap_clock - flap_start[i]) < FLAP_WINDOW)
+			continue;
+		
+		/* zapis podsumowania przebiega tak samo, jak zapis zmian stanu drzwi */
+		if((run = FlapFind(i + 1)))
+		{
+			cli();
+			device_flags.interrupts = 0;
+			
+			FlapEnd(run);
+			
+			device_flags.interrupts = 1;
+			sei();
+		}
+		
+		flap_count[i] = 0;
+	}
+}
+
+
+
+/**
+ * Rejestrowanie zmiany stanu jednych drzwi, z dat i czasem ze zmiennej now.<br>
+ * Jeli drzwi zmieni stan wicej ni FLAP_TOGGLES razy w oknie FLAP_WINDOW sekund, kolejne zmiany s tylko zliczane,
+ * a po ich ustaniu zapisywane jest podsumowanie serii (patrz @see FlapEnd).
+ * @param channel Numer drzwi
+ * @param event Kod zdarzenia (0 - drzwi otwarte, 1 - drzwi zamknite)
+ */
+void SaveDoor(uint8_t channel, uint8_t event)
+{
+	/* seria zmian stanu drzwi */
+	flap_run *run = FlapFind(channel);
 	
-	/* odczekanie a drgania zestykw ustan */
-	_delay_ms(80);
+	/* seria zmian jest w trakcie zliczania - zapamitanie ostatniej zmiany (po 255 zmianach zapisywane jest podsumowanie, a zliczanie zaczyna si od nowa) */
+	if(run)
+	{
+		run->last = now;
+		run->event = event;
+		flap_start[channel - 1] = flap_clock;
+		
+		if(++run->toggles == 255)
+			FlapEnd(run);
+		
+		return;
+	}
+	
+	/* pierwsza zmiana w oknie rozpoczyna odmierzanie okna */
+	if(!flap_count[channel - 1])
+		flap_start[channel - 1] = flap_clock;
+	
+	if(flap_count[channel - 1] < 255)
+		++flap_count[channel - 1];
 	
-	/* zapisujemy zdarzenie tylko jeli obecny stan drzwi jest przeciwny do poprzedniego */
-	if(device_flags.reed_switch == !(PIND & (1 << PIND3)))
+	/* przekroczenie progu rozpoczyna zliczanie serii zmian (o ile jest wolny element tablicy flap_runs) */
+	if(flap_count[channel - 1] > FLAP_TOGGLES && (run = FlapFind(0)))
 	{
-		/* zapisanie biecego stanu drzwi */
-		device_flags.reed_switch = (PIND & (1 << PIND3)) ? 1 : 0;
+		run->channel = channel;
+		run->toggles = 1;
+		run->event = event;
+		run->first = run->last = now;
+		flap_start[channel - 1] = flap_clock;
+	}
+	/* zapisanie do bufora rekordu o zdarzeniu */
+	else
+		StoreEvent(event, channel, 0);
+}
+
+
+
+/**
+ * Rejestrowanie zdarze otwarcia/zamknicia drzwi z jednej paczki zmian (wykrytych w tej samej prbce wej).<br>
+ * Wszystkie rekordy z paczki otrzymuj dat i czas chwili wykrycia zmian (a nie pobrania paczki z kolejki). Wywoywana przez funkcj @see DoorEvents.
+ * @param mask Maska drzwi, ktrych stan si zmieni (bit 0 - drzwi 1)
+ * @param state Stan wszystkich drzwi po zmianie (1 - drzwi otwarte)
+ * @param stamp Znacznik chwili wykrycia zmian, pobrany przez Timer/Counter0
+ */
+void SaveDoors(uint8_t mask, uint8_t state, const rtc_stamp *stamp)
+{
+	/* numer drzwi */
+	uint8_t channel;
+	/* stan przerwa i flagi device_flags.interrupts sprzed wywoania (w trakcie zapisu na kart SD w tle flaga jest wyzerowana) */
+	uint8_t sreg = SREG, interrupts = device_flags.interrupts;
+	
+	/* zapis przebiega tak samo, jak w procedurach obsugi przerwa - bez moliwoci przerwania go przez inne zdarzenia */
+	cli();
+	device_flags.interrupts = 0;
+	
+	/* wyznaczenie daty i czasu wykrycia zmian (raz dla caej paczki) */
+	RtcStampTime(&now, stamp);
 	
-		/* zapisanie do bufora rekordu o zdarzeniu */
+	/* rozpoczcie odmierzania czasu bez zmian stanu drzwi od nowa */
+	flush_idle = 0;
 	
-		if(PIND & (1 << PIND3))	/* PD3 == 1 -> drzwi otwarte */
-			SaveEvent(0);
-		else					/* PD3 == 0 -> drzwi zamknite */
-			SaveEvent(1);
+	for(channel = 1; mask; ++channel)
+	{
+		/* rejestrowanie zdarzenia: stan 1 -> drzwi otwarte (0), stan 0 -> drzwi zamknite (1) */
+		if(mask & 1)
+			SaveDoor(channel, state & 1 ? 0 : 1);
+		
+		mask >>= 1;
+		state >>= 1;
 	}
 	
-	/* umoliwienie funkcji SaveBuffer wczania przerwa */
-	device_flags.interrupts = 1;
+	/* przywrcenie stanu przerwa */
+	device_flags.interrupts = interrupts;
+	SREG = sreg;
+}
+
+
+
+/**
+ * Zapisuje zmiany stanu drzwi oczekujce w kolejce (patrz @see DoorGet) w aktywnym banku bufora.<br>
+ * Wywoywana w ptli gwnej programu oraz przez funkcj @see SaveBuffer pomidzy kolejnymi rekordami zapisywanymi w tle,
+ * dziki czemu kolejka (DOOR_QUEUE_SIZE paczek) nie zapenia si w trakcie zapisu na kart SD.
+ */
+void DoorEvents(void)
+{
+	/* paczka zmian stanu drzwi pobrana z kolejki */
+	uint8_t mask, state;
+	rtc_stamp stamp;
+	
+	while(DoorGet(&mask, &state, &stamp))
+		SaveDoors(mask, state, &stamp);
 }
 
 
@@ -440,6 +1310,9 @@ ISR(INT1_vect)
  */
 ISR(INT2_vect)
 {
+	/* nowa data i czas dla RTC, zapisywane w pamici EEPROM */
+	time new_date;
+	
 	/* zablokowanie funkcji SaveBuffer moliwoci wczania przerwa */
 	device_flags.interrupts = 0;
 	
@@ -458,7 +1331,7 @@ ISR(INT2_vect)
 				 * zmian sygnalizowane jest trzykrotnym szybkim migniciem zielonej diody */
 				case 0:
 				case 6:
-					BlinkGreen(3, 100, 100);
+					LedPattern(LED_GREEN, 3, 100, 100);
 				break;
 				
 				/* anulowanie/zatwierdzenie wprowadzonych zmian */
@@ -470,14 +1343,14 @@ ISR(INT2_vect)
 						set_rtc_cancelled = 0;
 						
 						/* sygnalizacja anulowania zmiany ustawie */
-						BlinkRed(3, 100, 100);
+						LedPattern(LED_RED, 3, 100, 100);
 					}
 					/* w przeciwnym razie wysyamy nowe ustawienia do RTC */
 					else
 					{
 						/* jeli w buforze brak miejsca na 2 rekordy + 1 na ew. informacj o braku karty SD (moe zosta zapisana wewntrz funkcji SaveEvent),
-						 * naley zapisa zawarto bufora na kart SD */
-						if(buffer_index > BUFFER_SIZE - 3)
+						 * naley zapisa zawarto bufora na kart SD (chyba e zapis wanie trwa w ptli gwnej programu - wtedy zmiana moe zosta anulowana) */
+						if(buffer_index > settings.buffer - 3 && !flush_busy)
 						{
 							/* jeli w trakcie operacji zapisu danych z bufora na kart SD wystpi bd,
 							 * urzdzenie zasygnalizuje to jako zapenienie bufora przy braku karty SD */
@@ -487,21 +1360,17 @@ ISR(INT2_vect)
 							 * jeli wczeniej zgoszono brak karty, w razie jej wykrycia naley zapisa informacj o tym w buforze */
 							 if(device_flags.no_sd_card)
 							 {
-								 SaveBuffer();
+								 SaveBuffer(0);
 							 
 								if(!device_flags.no_sd_card)
 									SaveEvent(5);
 							 }
 							 else
-								SaveBuffer();
+								SaveBuffer(0);
 							
 							/* jeli wystpi bd zapisu, a bufor jest peny, naley uniemoliwi zapisywanie kolejnych informacji do bufora, aby nie wyj poza zakres tej tablicy */
-							if(buffer_index >= BUFFER_SIZE)
-							{
-								buffer_index = BUFFER_SIZE;
-								
+							if(buffer_index >= settings.buffer)
 								device_flags.no_sd_card = 1;
-							}
 							else
 							{
 								/* jeli nie byo bdu zapisu, nastpuje wyczyszczenie flagi penego bufora przy braku karty SD */
@@ -516,7 +1385,7 @@ ISR(INT2_vect)
 									++buffer_index;
 									
 									/* jeli bufor wci nie jest peny, urzdzenie informowa ma tylko o braku karty SD */
-									if(buffer_index < BUFFER_SIZE)
+									if(buffer_index < settings.buffer)
 										device_flags.buffer_full = 0;
 								}
 							}
@@ -525,18 +1394,32 @@ ISR(INT2_vect)
 							device_flags.sd_communication_error = 0;
 						}
 					
-						if(buffer_index <= BUFFER_SIZE - 3)
+						/* jeli w pamici EEPROM czekaj rekordy, oba rekordy trafi do niej */
+						if(buffer_index <= settings.buffer - 3 || SpillCount())
 						{
 							/* zapisanie do bufora rekordu o zdarzeniu */
 							SaveEvent(4);
-						
-							/* zapisywanie w buforze stringowej reprezentacji nowych ustawie daty i czasu dla RTC, w formacie YY-MM-DD HH:ii:SS */
-							sprintf(buffer[buffer_index], "%02d-%02d-%02d %02d:%02d:%02d", set_rtc_values[Years], set_rtc_values[Century_months], set_rtc_values[Days],
-								set_rtc_values[Hours], set_rtc_values[Minutes], set_rtc_values[VL_seconds]);
-						
-							/* przesunicie wskanika bufora o 1 pozycj do przodu (normalnie robi to funkcja SaveEvent) */
-							++buffer_index;
-					
+							
+							/* nowa data i czas zapisywane s tu za rekordem o zdarzeniu, jako rekord o kodzie SPILL_NEW_DATE */
+							new_date.seconds = set_rtc_values[VL_seconds];
+							new_date.minutes = set_rtc_values[Minutes];
+							new_date.hours = set_rtc_values[Hours];
+							new_date.days = set_rtc_values[Days];
+							new_date.months = set_rtc_values[Century_months];
+							new_date.years = set_rtc_values[Years];
+							new_date.milliseconds = 0;
+							
+							/* rekord o zdarzeniu trafi do pamici EEPROM */
+							if(SpillCount())
+								SpillPut(&new_date, SPILL_NEW_DATE, 0, 0);
+							else
+							{
+								SpillPack(buffer[buffer_bank][buffer_index], &new_date, SPILL_NEW_DATE, 0, 0);
+							
+								/* przesunicie wskanika bufora o 1 pozycj do przodu (normalnie robi to funkcja SaveEvent) */
+								++buffer_index;
+							}
+							
 							/* zapisanie w RTC nowych ustawie daty i czasu */
 							RtcSetTime(set_rtc_values);
 						
@@ -544,15 +1427,12 @@ ISR(INT2_vect)
 							device_flags.vl = 0;
 						
 							/* sygnalizacja wysania nowych ustawie do RTC */
-							BlinkGreen(1, 1500, 100);
+							LedPattern(LED_GREEN, 1, 1500, 100);
 						}
 						else
 						{
-							/* opnienie, aby nastpi zauwaalny odstp pomidzy migniciami z SaveBuffer i tymi tutaj */
-							_delay_ms(300);
-							
 							/* sygnalizacja anulowania zmiany ustawie */
-							BlinkRed(3, 100, 100);
+							LedPattern(LED_RED, 3, 100, 100);
 						}
 					}
 				
@@ -566,7 +1446,7 @@ ISR(INT2_vect)
 				case 3:
 				case 4:
 				case 5:
-					BlinkGreen(set_rtc, 200, 100);
+					LedPattern(LED_GREEN, set_rtc, 200, 100);
 			}
 		}
 	}
@@ -673,12 +1553,12 @@ ISR(INT2_vect)
 			/* sygnalizacja przekroczenia zakresu biecej skadowej */
 			if(set_rtc_cancelled)
 			{
-				BlinkRed(2, 100, 100);
+				LedPattern(LED_RED, 2, 100, 100);
 				set_rtc_cancelled = 0;
 			}
 			/* sygnalizacja inkrementacji biecej skadowej */
 			else
-				BlinkRed(1, 200, 50);
+				LedPattern(LED_RED, 1, 200, 50);
 		}
 	}
 	
@@ -689,18 +1569,19 @@ ISR(INT2_vect)
 
 
 /**
- * Obsuga przerwa z 16-bitowego licznika Timer/Counter1.<br>
- * Przepenienie licznika po naliczaniu od wartoci startowej 36239 oznacza upyw okoo 30 sekund i powoduje zapis danych z bufora na karcie SD.
- * @param TIMER1_OVF_vect Wektor przerwania przy przepenieniu 16-bitowego licznika Timer/Counter1.
+ * Zapisuje dane z bufora i pamici EEPROM na kart SD (patrz @see SaveBuffer), obsugujc bdy zapisu i brak karty SD.<br>
+ * Timer RTC zatrzymywany jest dopiero po oprnieniu bufora i pamici EEPROM - w przeciwnym razie odlicza kolejne okresy.
+ * Wywoywana w ptli gwnej programu przy wyczonych przerwaniach i wyzerowanej fladze device_flags.interrupts (na czas samego zapisu przerwania s wczane).
  */
-ISR(TIMER1_OVF_vect)
+void FlushBuffer(void)
 {
-	/* zablokowanie funkcji SaveBuffer moliwoci wczania przerwa */
-	device_flags.interrupts = 0;
+	/* zapis zlecony ptli gwnej programu zostaje wykonany */
+	flush_request = 0;
+	flush_idle = 0;
 	
-	/* Przerwania o wyszych priorytetach mog (porednio lub bezporednio) wywoa SaveBuffer, a wtedy poniszy kod nie ma racji bytu.
-	 * Dlatego najpierw sprawdzamy czy w buforze s dane do zapisania. */
-	if(buffer_index > 0)
+	/* Bufor mg zosta oprniony wczeniej (np. po jego zapenieniu), a wtedy poniszy kod nie ma racji bytu.
+	 * Dlatego najpierw sprawdzamy czy w buforze (lub w pamici EEPROM) s dane do zapisania. */
+	if(buffer_index > 0 || drain_count || SpillCount())
 	{
 		/* jeli w trakcie operacji zapisu danych z bufora na kart SD wystpi bd,
 		 * urzdzenie zasygnalizuje to jako zapenienie bufora przy braku karty SD */
@@ -710,24 +1591,19 @@ ISR(TIMER1_OVF_vect)
 		 * jeli wczeniej zgoszono brak karty, w razie jej wykrycia naley zapisa informacj o tym w buforze */
 		if(device_flags.no_sd_card)
 		{
-			SaveBuffer();
+			SaveBuffer(1);
 			
 			if(!device_flags.no_sd_card)
 				SaveEvent(5);
 		}
 		else
-			SaveBuffer();
+			SaveBuffer(1);
 		
 		/* jeli wystpi bd zapisu, a bufor jest peny, naley uniemoliwi zapisywanie kolejnych informacji do bufora, aby nie wyj poza zakres tej tablicy */
-		if(buffer_index >= BUFFER_SIZE)
-		{
-			buffer_index = BUFFER_SIZE;
-			
+		if(buffer_index >= settings.buffer)
 			device_flags.no_sd_card = 1;
-		}
 		else
 		{
-			
 			/* jeli nie byo bdu zapisu, nastpuje wyczyszczenie flagi penego bufora przy braku karty SD */
 			if(!device_flags.sd_communication_error)
 				device_flags.buffer_full = 0;
@@ -740,24 +1616,38 @@ ISR(TIMER1_OVF_vect)
 				++buffer_index;
 				
 				/* jeli bufor wci nie jest peny, urzdzenie informowa ma tylko o braku karty SD */
-				if(buffer_index < BUFFER_SIZE)
+				if(buffer_index < settings.buffer)
 					device_flags.buffer_full = 0;
 			}
 		}
 		
-		/* wyczenie Timera/Countera 1 nastpuje tylko wtedy, gdy bufor zostanie oprniony */
-		if(buffer_index == 0)
-			TCCR1B &= 250;
+		/* zatrzymanie timera RTC nastpuje tylko wtedy, gdy bufor i pami EEPROM zostan oprnione */
+		if(buffer_index == 0 && !drain_count && !SpillCount())
+			FlushStop();
 		
 		/* wyczyszczenie flagi bdu komunikacji z kart SD */
 		device_flags.sd_communication_error = 0;
-		
-		/* ustawienie w liczniku wartoci startowej */
-		TCNT1 = 36239;
 	}
+	else
+		/* bufor oprniono wczeniej (np. po jego zapenieniu) - timer RTC nie jest ju potrzebny */
+		FlushStop();
 	
-	/* umoliwienie funkcji SaveBuffer wczania przerwa */
-	device_flags.interrupts = 1;
+}
+
+
+
+/**
+ * Obsuga przerwa z wyjcia INT zegara RTC (PD2).<br>
+ * Upyw settings.flush sekund od zarejestrowania najstarszego rekordu w buforze powoduje zlecenie zapisu danych z bufora na karcie SD
+ * (zapis wykonywany jest w ptli gwnej programu, przy wczonych przerwaniach). Timer RTC odlicza kolejne okresy a do oprnienia bufora.
+ * @param INT0_vect Wektor przerwania zewntrznego INT0.
+ */
+ISR(INT0_vect)
+{
+	/* wyczyszczenie flagi TF w RTC - zwolnienie wyjcia INT przed kolejnym okresem */
+	RtcClearTimer();
+	
+	flush_request = 1;
 }
 
 
@@ -778,10 +1668,10 @@ int main(void)
 	
 #pragma region UstawieniaPrzerwan
 
-	/* wczenie przerwa zewntrznych INT1 i INT2 */
-	GICR |= 1 << INT1 | 1 << INT2;
-	/* ustawienie generacji przerwania INT1 przy dowolnej zmianie poziomu logicznego */
-	MCUCR |= 0 << ISC11 | 1 << ISC10;
+	/* wczenie przerwa zewntrznych INT0 i INT2 (kontaktrony s prbkowane przez Timer/Counter0) */
+	GICR |= 1 << INT0 | 1 << INT2;
+	/* ustawienie generacji przerwania INT0 przy zboczu opadajcym (RTC wystawia stan niski na wyjciu INT po upywie okresu timera) */
+	MCUCR |= 1 << ISC01 | 0 << ISC00;
 	/* generacja przerwania INT2 przy zboczu opadajcym jest ustawiona domylnie */
 
 #pragma endregion UstawieniaPrzerwan
@@ -794,37 +1684,57 @@ int main(void)
        PB6(MISO) wejciowy (dane odbierane z karty SD)	} inicjalizacja w
        PB5(MOSI) wyjciowy (dane wysyane do karty SD)	} pliku sdmm.c
        PB4(SS)   wyjciowy (slave select)				}
+       PB3(AIN1) wejciowy z rezystorem podcigajcym (wyjcie CLKOUT zegara RTC typu otwarty dren, 1 Hz)
        PB2(INT2) wejciowy (przerwania zewntrzne wywoywane przyciskami)
        PB1       wejciowy (przycisk)
        PB0       wejciowy (przycisk)*/
-	PORTB = 1 << PB2 | 1 << PB1 | 1 << PB0;
+	PORTB = 1 << PB3 | 1 << PB2 | 1 << PB1 | 1 << PB0;
 	
 	/* PC1 (SDA) i PC0 (SCL) s wykorzystywane przez TWI, wic wczam wewntrzne rezystory podcigajce */
 	PORTC = 1 << PC1 | 1 << PC0;
 	
+	/* PA7 - PA0 wejciowe z rezystorami podcigajcymi (kontaktrony) - inicjalizacja w pliku doors.c */
+	
 	/* PD7 i PD6 wyjciowe (diody)
-       PD3(INT1) wejciowy (przerwania zewntrzne od kontaktronu) */
+       PD2(INT0) wejciowy z rezystorem podcigajcym (wyjcie INT zegara RTC typu otwarty dren) */
 	DDRD = 1 << PD7 | 1 << PD6;
-	PORTD = 1 << PD3;
+	PORTD = 1 << PD2;
 	
 #pragma endregion UstawieniaPinow
 	
+	/* wczenie moduu TWI (komunikacja z RTC) i pomiaru czci uamkowych sekundy */
+	TwiInit();
+	RtcInitClock();
+	
 	/* owiecenie diody LED1 (zielonej) */
-	PORTD |= 1 << PD7;
+	PORTD |= LED_GREEN;
 	
-	/* zapisanie biecego stanu drzwi */
-	device_flags.reed_switch = (PIND & (1 << PIND3)) ? 1 : 0;
+	/* odtworzenie stanu bufora w pamici EEPROM (rekordy sprzed wyczenia urzdzenia zostan przepisane na kart SD) */
+	SpillInit();
 	
 	/* zapisanie informacji o wczeniu urzdzenia */
 	SaveEvent(2);
 	
 #pragma region UstawieniaTimerCounter
 
-	/* wczenie przerwania przy przepenieniu licznika Timer/Counter1 (16-bit) */
-	TIMSK = 1 << TOIE1;
+	/* Timer/Counter2 steruje diodami (sygnalizacja stanu i sekwencje migni) i odmierza sekundy dla ptli gwnej programu */
+	LedInit();
+	
+	/* Timer/Counter0 prbkuje wejcia kontaktronw (biecy stan drzwi zapamitywany jest bez zapisywania zdarze) */
+	DoorInit();
+	
+	/* odczyt ustawie z pliku konfiguracyjnego, jeli karta SD jest obecna (w przeciwnym razie nastpi on przy pierwszym zapisie bufora) */
+	if(f_mount(&FatFs, "", 1) == FR_OK)
+	{
+		LoadConfig();
+		f_mount(NULL, "", 0);
+	}
 
 #pragma endregion UstawieniaTimerCounter
 	
+	/* w trybie bezczynnoci (idle) dziaaj liczniki, TWI i przerwania zewntrzne wyzwalane zboczem */
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	
 	/* wczenie przerwa */
 	sei();
 	
@@ -833,56 +1743,56 @@ int main(void)
 	/************************************************************************/
     for(;;)
     {
-        /* flaga VL ustawiona => dioda zielona miga (ok. 0,5 Hz)
-         * w przeciwnym razie => dioda zielona wieci si cigle */
-		if(device_flags.vl)
-			PORTD ^= 128;
-		else
-			PORTD |= 128;
+		/* zapisanie zmian stanu drzwi wykrytych przez Timer/Counter0 */
+		DoorEvents();
 		
-		/* brak karty SD (i ew. bufor peny) => dioda czerwona miga
-		 *                w przeciwnym razie => dioda czerwona jest zgaszona */
-		if(device_flags.no_sd_card || device_flags.buffer_full)
-			PORTD ^= 64;
-		else
-			PORTD &= 191;
-		
-		/* no_sd_card										ok. 0,5 Hz
-		 * buffer_full (bd komunikacji z kart)			ok. 1 Hz
-		 * no_sd_card && buffer_full						ok. 2 Hz
-		 * Poniewa funkcja _delay_ms wycza przerwania, trzeba je wcza po zakoczeniu oczekiwania.
-		 * Aby zminimalizowa czas oczekiwania na obsug przerwania (i w efekcie jak najczciej umoliwia rejestracj przerwania o tym samym priorytecie),
-		 * odmierzanie czasu do zmiany stanu diod zostao podzielone na sekwencje 'delay' oczekiwa po 50 ms. */
-		if(device_flags.buffer_full)
+		/* zadania wykonywane raz na sekund */
+		if(second_tick)
 		{
-			/* odczekanie 250 ms */
-			delay(5, 50);
+			second_tick = 0;
 			
-			/* jeli obie flagi s ustawione, dioda czerwona ma zmienia stan co 250 ms,
-			 * jeli tylko buffer_full jest ustawiona, dioda czerwona ma zmienia stan co 500 ms */
-			if(device_flags.no_sd_card)
-				PORTD ^= 64;
+			/* przerwanie zablokowanej transmisji TWI i rozpoczcie odczytu daty i czasu z RTC w tle */
+			TwiCheck();
+			RtcStartSync();
 			
-			/* odczekanie 250 ms */
-			delay(5, 50);
+			/* zapisanie podsumowa serii zmian stanu drzwi, ktre ustay */
+			FlapCheck();
 			
-			/* zmiana stanu diody czerwonej */
-			PORTD ^= 64;
+			/* po settings.idle sekundach bez zmian stanu drzwi bufor zapisywany jest na kart SD (przy braku karty - tylko po upywie czasu timera RTC) */
+			if((buffer_index || drain_count) && !device_flags.no_sd_card && ++flush_idle >= settings.idle)
+				flush_request = 1;
 			
-			/* odczekanie 250 ms */
-			delay(5, 50);
+#if LOG_ROTATION
+			/* utworzenie zawczasu pliku z logiem na kolejny dzie (miesic), gdy w buforze nie czekaj adne rekordy */
+			if(log_prepare && !buffer_index && !drain_count)
+				PrepareNextLog();
+#endif
+		}
+		
+		/* zapisanie bufora na kart SD po osigniciu progu zapenienia, upywie czasu bez zmian stanu drzwi lub upywie czasu timera RTC (przerwanie INT0) */
+		if(flush_request)
+		{
+			cli();
+			device_flags.interrupts = 0;
 			
-			/* zmiana po 250 ms jeli obie flagi ustawione */
-			if(device_flags.no_sd_card)
-				PORTD ^= 64;
+			FlushBuffer();
 			
-			/* odczekanie 250 ms */
-			delay(5, 50);
+			device_flags.interrupts = 1;
+			sei();
 		}
-		else
+		
+		/* upienie procesora do czasu kolejnego przerwania (przerwania wczane s dopiero w instrukcji poprzedzajcej SLEEP,
+		 * wic ustawienie flagi second_tick lub flush_request albo zmiana stanu drzwi tu przed upieniem nie zostan przeoczone) */
+		cli();
+		
+		if(!second_tick && !DoorPending() && !flush_request)
 		{
-			/* odczekanie 1000 ms */
-			delay(20, 50);
+			sleep_enable();
+			sei();
+			sleep_cpu();
+			sleep_disable();
 		}
+		
+		sei();
     }
 }
@@ -2,11 +2,21 @@
 # Automatically-generated file. Do not edit or delete the file
 ################################################################################
 
+config.c
+
+doors.c
+
 ff.c
 
+led.c
+
 Logger.c
 
 rtc.c
 
 sdmm.c
 
+spill.c
+
+twi.c
+
@@ -0,0 +1,216 @@
+/*
+ *  config.c
+ *
+ *  Utworzono: 2015-02-07 11:24:52
+ *  Autor: Adam Grser
+ */
+
+#include <avr/pgmspace.h>
+#include <string.h>
+#include "config.h"
+
+
+
+config settings = { FLUSH_PERIOD, FLUSH_IDLE, FLUSH_HIGH, BUFFER_SIZE, DEBOUNCE_TIME, 100, LOG_NAME };
+
+
+
+/**
+ * Przywrcenie ustawie domylnych.
+ */
+static void ConfigDefaults(void)
+{
+	settings.flush = FLUSH_PERIOD;
+	settings.idle = FLUSH_IDLE;
+	settings.high = FLUSH_HIGH;
+	settings.buffer = BUFFER_SIZE;
+	settings.debounce = DEBOUNCE_TIME;
+	settings.blink = 100;
+	strcpy_P(settings.log, PSTR(LOG_NAME));
+}
+
+
+
+/**
+ * Zamiana wartoci ustawienia na liczb.
+ * @param value Warto ustawienia (same cyfry)
+ * @param min Najmniejsza dopuszczalna warto
+ * @param max Najwiksza dopuszczalna warto
+ * @return Liczba lub 0, jeli warto nie jest liczb z zakresu od 'min' do 'max'
+ */
+static uint16_t ConfigNumber(const char *value, uint16_t min, uint16_t max)
+{
+	uint16_t n = 0;
+
+	if(!*value)
+		return 0;
+
+	for(; *value; ++value)
+	{
+		if(*value < '0' || *value > '9' || n > 9999)
+			return 0;
+
+		n = n * 10 + *value - '0';
+	}
+
+	return n >= min && n <= max ? n : 0;
+}
+
+
+
+/**
+ * Sprawdzenie, czy warto ustawienia 'log' moe zosta uyta w nazwie pliku.
+ * @param value Warto ustawienia
+ * @return 1 jeli warto jest poprawna
+ */
+static uint8_t ConfigName(const char *value)
+{
+	/* dugo nazwy i rozszerzenia */
+	uint8_t name = 0, ext = 0;
+	/* determinuje czy wystpia kropka */
+	uint8_t dot = 0;
+
+	for(; *value; ++value)
+	{
+		if(*value == '.' && !dot && name)
+			dot = 1;
+		else if((*value >= 'A' && *value <= 'Z') || (*value >= 'a' && *value <= 'z') || (*value >= '0' && *value <= '9') || *value == '_' || *value == '-')
+		{
+			if(dot)
+				++ext;
+			else
+				++name;
+		}
+		else
+			return 0;
+	}
+
+#if LOG_ROTATION
+	/* przedrostek nazwy pliku (pozostae 6 znakw to data) */
+	return name == CONFIG_LOG_SIZE - 1 && !dot;
+#else
+	return name && name <= 8 && ext <= 3 && (!dot || ext);
+#endif
+}
+
+
+
+/**
+ * Zastosowanie jednego wiersza pliku konfiguracyjnego.
+ * @param line Wiersz bez znakw nowej linii
+ */
+static void ConfigLine(char *line)
+{
+	char *value = strchr(line, '=');
+	/* warto liczbowa ustawienia */
+	uint16_t n;
+
+	/* wiersz pusty, komentarz lub wiersz bez znaku '=' */
+	if(!value || *line == '#' || *line == ';')
+		return;
+
+	*value++ = '\0';
+
+	if(!strcmp_P(line, PSTR("flush")))
+	{
+		if((n = ConfigNumber(value, 1, 255)))
+			settings.flush = n;
+	}
+	else if(!strcmp_P(line, PSTR("idle")))
+	{
+		if((n = ConfigNumber(value, 1, 255)))
+			settings.idle = n;
+	}
+	else if(!strcmp_P(line, PSTR("high")))
+	{
+		if((n = ConfigNumber(value, 1, BUFFER_SIZE)))
+			settings.high = n;
+	}
+	else if(!strcmp_P(line, PSTR("buffer")))
+	{
+		if((n = ConfigNumber(value, 4, BUFFER_SIZE)))
+			settings.buffer = n;
+	}
+	else if(!strcmp_P(line, PSTR("debounce")))
+	{
+		if((n = ConfigNumber(value, 20, 1000)))
+			settings.debounce = n;
+	}
+	else if(!strcmp_P(line, PSTR("blink")))
+	{
+		if((n = ConfigNumber(value, 25, 250)))
+			settings.blink = n;
+	}
+	else if(!strcmp_P(line, PSTR("log")))
+	{
+		if(ConfigName(value))
+			strcpy(settings.log, value);
+	}
+}
+
+
+
+FRESULT ConfigLoad(FIL *fp)
+{
+	FRESULT res;
+	/* biecy wiersz pliku (bez spacji i tabulacji) */
+	char line[CONFIG_LINE];
+	/* dugo wiersza (warto CONFIG_LINE oznacza zbyt dugi wiersz) */
+	uint8_t length = 0;
+	/* odczytany znak */
+	char c;
+	/* liczba odczytanych bajtw */
+	UINT br;
+
+	ConfigDefaults();
+
+	res = f_open(fp, CONFIG_FILE, FA_READ);
+
+	if(res != FR_OK)
+		return res;
+
+	for(;;)
+	{
+		/* plik jest may i czytany znak po znaku (sektor pozostaje w oknie systemu plikw) */
+		res = f_read(fp, &c, 1, &br);
+
+		if(res != FR_OK)
+			break;
+
+		/* koniec wiersza lub pliku */
+		if(!br || c == '\n' || c == '\r')
+		{
+			if(length < CONFIG_LINE)
+			{
+				line[length] = '\0';
+				ConfigLine(line);
+			}
+
+			length = 0;
+
+			if(!br)
+				break;
+		}
+		/* spacje i tabulacje s pomijane */
+		else if(c != ' ' && c != '\t' && length < CONFIG_LINE)
+		{
+			/* ostatni znak bufora jest zarezerwowany dla znaku \0 */
+			if(length < CONFIG_LINE - 1)
+				line[length++] = c;
+			else
+				length = CONFIG_LINE;
+		}
+	}
+
+	/* niepoprawne wartoci pozostawiaj ustawienia domylne, bd odczytu - wszystkie ustawienia domylne */
+	if(res != FR_OK)
+		ConfigDefaults();
+
+	/* prg zapisu bufora nie moe przekracza jego rozmiaru (klucze mog wystpi w dowolnej kolejnoci) */
+	if(settings.high > settings.buffer)
+		settings.high = settings.buffer;
+
+	f_close(fp);
+
+	return res;
+}
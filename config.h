@@ -0,0 +1,117 @@
+/*
+ *  config.h
+ *
+ *  Utworzono: 2015-02-07 11:24:52
+ *  Autor: Adam Grser
+ */
+
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stdint-gcc.h>
+#include "ff.h"
+#include "utils.h"
+#include "timing.h"
+
+
+
+/// Nazwa pliku konfiguracyjnego w katalogu gwnym karty SD.
+#define CONFIG_FILE "CONFIG.TXT"
+
+/// Maksymalna dugo wiersza pliku konfiguracyjnego (dusze wiersze s pomijane).
+#define CONFIG_LINE 24
+
+/// Rozmiar banku bufora (liczba rekordw w kadym z dwch bankw) - grna granica ustawienia 'buffer'.
+#define BUFFER_SIZE 10
+
+/// Domylny maksymalny czas (w sekundach) od zarejestrowania najstarszego rekordu w buforze do zapisu bufora na kart SD, odmierzany przez timer RTC.
+#define FLUSH_PERIOD 30
+
+/// Domylny czas (w sekundach) bez zmian stanu drzwi, po ktrym bufor zapisywany jest na kart SD.
+#define FLUSH_IDLE 5
+
+/// Domylna liczba rekordw w buforze, po ktrej bufor zapisywany jest na kart SD w ptli gwnej programu (przed zapenieniem bufora).
+#define FLUSH_HIGH 8
+
+#if FLUSH_HIGH > BUFFER_SIZE
+#error FLUSH_HIGH must not exceed BUFFER_SIZE.
+#endif
+
+/// Domylny czas eliminacji drga zestykw kontaktronw (w milisekundach) - 4 prbki przy czstotliwoci DOOR_SCAN_HZ.
+#define DEBOUNCE_TIME (4000 / DOOR_SCAN_HZ)
+
+/**
+ * Sposb podziau logu na pliki: 0 - jeden plik DoorLog.txt (domylnie, plik czytany przez dotychczasowe narzdzia), 1 - osobny plik na kady dzie (DLYYMMDD.TXT),
+ * 2 - osobny plik na kady miesic (DLYYMM.TXT, rozszerzenie LOG_EXTENSION). Nazw pliku (przedrostek DL) mona zmieni ustawieniem 'log'.<br>
+ * Plik wybierany jest na podstawie daty zapisanej w rekordzie, a nie biecej daty z RTC.
+ */
+#define LOG_ROTATION 0
+
+/**
+ * Format pliku z logiem: 0 - tekstowy (wiersze zakoczone znakami CRLF), 1 - binarny (8-bajtowy nagwek i 8-bajtowe rekordy
+ * o ukadzie rekordw z pamici EEPROM, patrz @see SpillPack).<br>
+ * Rekordy binarne nie przekraczaj granic sektorw, a plik binarny mona zindeksowa bez analizowania wierszy.
+ */
+#define LOG_FORMAT 0
+
+#if LOG_FORMAT
+/// Rozszerzenie nazw plikw z logiem.
+#define LOG_EXTENSION ".BIN"
+#else
+/// Rozszerzenie nazw plikw z logiem.
+#define LOG_EXTENSION ".TXT"
+#endif
+
+#if LOG_ROTATION
+/// Rozmiar ustawienia 'log' - dwuznakowy przedrostek nazw plikw z logiem (wraz ze znakiem \0).
+#define CONFIG_LOG_SIZE 3
+/// Domylny przedrostek nazw plikw z logiem.
+#define LOG_NAME "DL"
+#else
+/// Rozmiar ustawienia 'log' - nazwa pliku z logiem w formacie 8.3 (wraz ze znakiem \0).
+#define CONFIG_LOG_SIZE 13
+#if LOG_FORMAT
+/// Domylna nazwa pliku z logiem.
+#define LOG_NAME "DoorLog.bin"
+#else
+/// Domylna nazwa pliku z logiem.
+#define LOG_NAME "DoorLog.txt"
+#endif
+#endif
+
+/**
+ * Ustawienia urzdzenia, ktre mona zmieni w pliku konfiguracyjnym (wiersze "klucz=warto").
+ * @field flush Klucz 'flush' - maksymalny czas od zarejestrowania najstarszego rekordu w buforze do zapisu bufora na kart SD (od 1 do 255 s)
+ * @field idle Klucz 'idle' - czas bez zmian stanu drzwi, po ktrym bufor zapisywany jest na kart SD (od 1 do 255 s)
+ * @field high Klucz 'high' - liczba rekordw w aktywnym banku bufora, po ktrej bufor zapisywany jest na kart SD (od 1 do wartoci ustawienia 'buffer')
+ * @field buffer Klucz 'buffer' - liczba rekordw w aktywnym banku bufora, po ktrej wymuszany jest natychmiastowy zapis na kart SD (od 4 do BUFFER_SIZE)
+ * @field debounce Klucz 'debounce' - czas eliminacji drga zestykw kontaktronw (od 20 do 1000 ms, przy kadej czstotliwoci F_CPU - patrz @see DoorDebounce)
+ * @field blink Klucz 'blink' - czas trwania migni diod w procentach czasw domylnych (od 25 do 250 %)
+ * @field log Klucz 'log' - przedrostek nazw plikw z logiem (gdy LOG_ROTATION > 0) lub nazwa pliku z logiem
+ */
+typedef struct {
+	uint8_t flush;
+	uint8_t idle;
+	uint8_t high;
+	uint8_t buffer;
+	uint16_t debounce;
+	uint8_t blink;
+	char log[CONFIG_LOG_SIZE];
+} config;
+
+/// Biece ustawienia urzdzenia.
+extern config settings;
+
+
+
+/**
+ * Przywrcenie ustawie domylnych i odczyt pliku konfiguracyjnego z zamontowanego systemu plikw.<br>
+ * Wartoci spoza dopuszczalnego zakresu, nieznane klucze i niepoprawne wiersze s pomijane (obowizuj wtedy ustawienia domylne).
+ * @param fp Obiekt pliku, ktry nie jest w tej chwili uywany (po odczycie plik zostaje zamknity)
+ * @return FR_OK jeli odczytano plik, FR_NO_FILE jeli go nie ma (obowizuj ustawienia domylne), w przeciwnym razie kod bdu zwrcony przez FatFS
+ */
+FRESULT ConfigLoad(FIL *fp);
+
+
+
+#endif /* CONFIG_H */
@@ -0,0 +1,176 @@
+/*
+ *  doors.c
+ *
+ *  Utworzono: 2015-01-31 09:12:44
+ *  Autor: Adam Grser
+ */
+
+#include "doors.h"
+
+
+
+/**
+ * Paczka zmian stanu drzwi.
+ * @field mask Maska drzwi, ktrych stan si zmieni
+ * @field state Stan wszystkich drzwi po zmianie
+ * @field stamp Znacznik chwili wykrycia zmian
+ */
+typedef struct {
+	uint8_t mask;
+	uint8_t state;
+	rtc_stamp stamp;
+} door_batch;
+
+/// Kolejka paczek zmian stanu drzwi (bufor cykliczny).
+static door_batch door_queue[DOOR_QUEUE_SIZE];
+
+/// Indeks pierwszego elementu kolejki.
+static uint8_t door_head = 0;
+
+/// Liczba paczek w kolejce.
+static volatile uint8_t door_count = 0;
+
+/// Stan drzwi po eliminacji drga zestykw (1 - drzwi otwarte).
+static uint8_t door_state = 0;
+
+/// Liczba przerwa licznika Timer/Counter0 na jedn prbk (okres prbkowania duszy ni zakres licznika dzielony jest programowo).
+static uint8_t door_divider = 1;
+
+/// Liczba przerwa licznika Timer/Counter0 od ostatniej prbki.
+static uint8_t door_tick = 0;
+
+///@name Liczniki_pionowe
+//@{
+	/// Bity 0 i 1 dwubitowych licznikw (po jednym na kade wejcie), odliczajcych kolejne prbki rne od stanu door_state
+	static uint8_t door_ct0 = 0xFF, door_ct1 = 0xFF;
+//@}
+
+
+
+/**
+ * Obsuga przerwa z licznika Timer/Counter0 (DOOR_SCAN_HZ razy na sekund).<br>
+ * Prbkowanie wszystkich wej naraz i eliminacja drga zestykw licznikami pionowymi (bit n kadego licznika naley do wejcia n).
+ * @param TIMER0_COMP_vect Wektor przerwania przy zrwnaniu licznika Timer/Counter0 z rejestrem OCR0.
+ */
+ISR(TIMER0_COMP_vect)
+{
+	/* wejcia, ktrych prbka rni si od stanu door_state */
+	uint8_t changed;
+	door_batch *batch;
+
+	/* prbka pobierana jest co door_divider przerwa */
+	if(++door_tick < door_divider)
+		return;
+
+	door_tick = 0;
+	changed = (DOOR_PIN & DOOR_MASK) ^ door_state;
+
+	/* liczniki wej zgodnych z door_state s zerowane (warto 3), pozostae odliczaj w d */
+	door_ct0 = ~(door_ct0 & changed);
+	door_ct1 = door_ct0 ^ (door_ct1 & changed);
+
+	/* zmiana, ktra utrzymaa si przez 4 kolejne prbki (licznik si przepeni) */
+	changed &= door_ct0 & door_ct1;
+
+	if(!changed)
+		return;
+
+	door_state ^= changed;
+
+	/* zmiany z jednej prbki trafiaj do jednej paczki, a po zapenieniu kolejki - do ostatniej paczki */
+	if(door_count < DOOR_QUEUE_SIZE)
+	{
+		batch = &door_queue[(door_head + door_count) % DOOR_QUEUE_SIZE];
+		batch->mask = 0;
+		++door_count;
+	}
+	else
+		batch = &door_queue[(door_head + DOOR_QUEUE_SIZE - 1) % DOOR_QUEUE_SIZE];
+
+	batch->mask |= changed;
+	batch->state = door_state;
+
+	/* chwila wykrycia zmian zapamitywana jest od razu - paczka moe czeka w kolejce na zapisanie nawet przez cay zapis na kart SD */
+	RtcStamp(&batch->stamp);
+}
+
+
+
+void DoorInit(void)
+{
+	/* wejcia z rezystorami podcigajcymi (kontaktron zwarty do masy - drzwi zamknite) */
+	DOOR_DDR &= (uint8_t)~DOOR_MASK;
+	DOOR_PORT |= DOOR_MASK;
+
+	/* odczekanie na ustalenie si stanu wej po wczeniu rezystorw podcigajcych */
+	_delay_us(10);
+
+	door_state = DOOR_PIN & DOOR_MASK;
+
+	/* Timer/Counter0 w trybie CTC z preskalerem DOOR_SCAN_PRESCALER */
+	OCR0 = DOOR_SCAN_OCR;
+	TCCR0 = 1 << WGM01 | DOOR_SCAN_CLOCK_SELECT;
+	TIMSK |= 1 << OCIE0;
+}
+
+
+
+uint8_t DoorGet(uint8_t *mask, uint8_t *state, rtc_stamp *stamp)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+
+	if(!door_count)
+	{
+		SREG = sreg;
+
+		return 0;
+	}
+
+	*mask = door_queue[door_head].mask;
+	*state = door_queue[door_head].state;
+	*stamp = door_queue[door_head].stamp;
+
+	door_head = (door_head + 1) % DOOR_QUEUE_SIZE;
+	--door_count;
+
+	SREG = sreg;
+
+	return 1;
+}
+
+
+
+void DoorDebounce(uint16_t ms)
+{
+	uint8_t sreg = SREG;
+	/* zmiana musi utrzyma si przez 4 prbki, wic okres prbkowania to ms / 4 (w taktach licznika) */
+	uint32_t ticks = (uint32_t)ms * (F_CPU / DOOR_SCAN_PRESCALER) / 4000;
+	/* najmniejsza liczba przerwa na prbk, przy ktrej okres przerwa mieci si w zakresie licznika */
+	uint16_t divider = ticks / 256 + 1;
+
+	if(divider > 255)
+		divider = 255;
+
+	ticks /= divider;
+
+	cli();
+
+	door_divider = divider;
+	door_tick = 0;
+
+	OCR0 = ticks > 256 ? 255 : (ticks > 1 ? ticks - 1 : 1);
+
+	/* licznik mg ju min now warto OCR0 - rozpoczcie odliczania od nowa */
+	TCNT0 = 0;
+
+	SREG = sreg;
+}
+
+
+
+uint8_t DoorPending(void)
+{
+	return door_count != 0;
+}
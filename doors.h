@@ -0,0 +1,70 @@
+/*
+ *  doors.h
+ *
+ *  Utworzono: 2015-01-31 09:12:44
+ *  Autor: Adam Grser
+ */
+
+#ifndef DOORS_H
+#define DOORS_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint-gcc.h>
+#include "utils.h"
+#include "timing.h"
+#include "rtc.h"
+
+
+
+///@name Port_kontaktronow
+//@{
+	/// Rejestr wyjciowy portu, do ktrego podczone s kontaktrony (PA0 - drzwi 1, ..., PA7 - drzwi 8)
+	#define DOOR_PORT PORTA
+	/// Rejestr wejciowy portu kontaktronw
+	#define DOOR_PIN PINA
+	/// Rejestr kierunku portu kontaktronw
+	#define DOOR_DDR DDRA
+//@}
+
+/// Maska wej, do ktrych podczone s kontaktrony (pozostae wejcia s ignorowane).
+#define DOOR_MASK 0xFF
+
+/// Maksymalna liczba paczek zmian stanu drzwi oczekujcych na zapisanie.
+#define DOOR_QUEUE_SIZE 4
+
+
+
+/**
+ * Wczenie rezystorw podcigajcych na wejciach kontaktronw, zapamitanie biecego stanu drzwi
+ * i uruchomienie licznika Timer/Counter0, ktry prbkuje wejcia.
+ */
+void DoorInit(void);
+
+/**
+ * Pobranie z kolejki najstarszej paczki zmian stanu drzwi (zmian wykrytych w tej samej prbce).<br>
+ * Jeli kolejka si zapeni, kolejne zmiany doczane s do ostatniej paczki (a znacznik chwili paczki wskazuje najnowsz zmian).
+ * @param mask Zmienna, do ktrej zapisana zostanie maska drzwi, ktrych stan si zmieni (bit 0 - drzwi 1)
+ * @param state Zmienna, do ktrej zapisany zostanie stan wszystkich drzwi po zmianie (1 - drzwi otwarte)
+ * @param stamp Struktura, do ktrej zapisany zostanie znacznik chwili wykrycia zmian (patrz @see RtcStampTime)
+ * @return 1 jeli pobrano paczk zmian, 0 jeli kolejka jest pusta
+ */
+uint8_t DoorGet(uint8_t *mask, uint8_t *state, rtc_stamp *stamp);
+
+/**
+ * Zmiana czasu eliminacji drga zestykw (czasu, przez jaki musi utrzyma si zmiana stanu drzwi) poprzez zmian czstotliwoci prbkowania wej.<br>
+ * Okres prbkowania duszy ni zakres licznika Timer/Counter0 (256 * DOOR_SCAN_PRESCALER taktw) dzielony jest programowo na kilka przerwa,
+ * wic cay zakres ustawienia 'debounce' (od 20 do 1000 ms) jest dostpny przy kadej czstotliwoci F_CPU.
+ * @param ms Czas w milisekundach (ograniczany do 255 okresw licznika Timer/Counter0 na prbk)
+ */
+void DoorDebounce(uint16_t ms);
+
+/**
+ * Sprawdzenie, czy w kolejce czekaj zmiany stanu drzwi.
+ * @return 1 jeli kolejka nie jest pusta
+ */
+uint8_t DoorPending(void);
+
+
+
+#endif /* DOORS_H */
@@ -151,8 +151,44 @@
 #endif
 #if _MAX_SS == _MIN_SS
 #define	SS(fs)	((UINT)_MIN_SS)	/* Fixed sector size */
+#define	SSHIFT(fs)	(_MIN_SS == 512 ? 9 : _MIN_SS == 1024 ? 10 : _MIN_SS == 2048 ? 11 : 12)	/* Fixed sector size in log2 */
 #else
 #define	SS(fs)	((fs)->ssize)	/* Variable sector size */
+#define	SSHIFT(fs)	((fs)->sshift)	/* Variable sector size in log2 */
+#endif
+
+
+/* FAT sub-type */
+#if _FS_ONLYFAT == 32
+#define	FSTYPE(fs)	((void)(fs), FS_FAT32)	/* Fixed FAT sub-type (fs is still referenced) */
+#elif _FS_ONLYFAT == 16
+#define	FSTYPE(fs)	((void)(fs), FS_FAT16)	/* Fixed FAT sub-type (fs is still referenced) */
+#elif _FS_ONLYFAT == 0
+#define	FSTYPE(fs)	((fs)->fs_type)	/* FAT sub-type of the mounted volume */
+#else
+#error Wrong _FS_ONLYFAT setting.
+#endif
+
+
+/* Sector window cache */
+#if _FS_WINDOWS < 1 || _FS_WINDOWS > 4
+#error Wrong _FS_WINDOWS setting.
+#endif
+#if _FS_FATWIN && _FS_WINDOWS < 3
+#error _FS_FATWIN requires _FS_WINDOWS >= 3.
+#endif
+#if _FS_FREEMAP < 0 || _FS_FREEMAP > 64
+#error Wrong _FS_FREEMAP setting.
+#endif
+#if _FS_LAZYFAT < 0 || _FS_LAZYFAT > 8 || _FS_CHECKPOINT < 0 || _FS_CHECKPOINT > 255
+#error Wrong _FS_LAZYFAT or _FS_CHECKPOINT setting.
+#endif
+#if _FS_READONLY
+#undef _FS_LAZYFAT
+#define _FS_LAZYFAT 0
+#endif
+#if _USE_OPENLOC && (_FS_READONLY || _FS_LOCK)
+#error _USE_OPENLOC must be 0 at read-only cfg or with _FS_LOCK.
 #endif
 
 
@@ -535,8 +571,16 @@ WCHAR LfnBuf[_MAX_LFN+1];
 
 
 #ifdef _EXCVT
+#if defined(__GNUC__) && defined(__AVR__)	/* Keep the table in the program memory of AVR */
+#include <avr/pgmspace.h>
+static
+const BYTE ExCvt[] PROGMEM = _EXCVT;	/* Upper conversion table for extended characters */
+#define EXCVT(c) pgm_read_byte(&ExCvt[(c) - 0x80])
+#else
 static
 const BYTE ExCvt[] = _EXCVT;	/* Upper conversion table for extended characters */
+#define EXCVT(c) ExCvt[(c) - 0x80]
+#endif
 #endif
 
 
@@ -750,28 +794,216 @@ void clear_lock (	/* Clear lock entries of the volume */
 /*-----------------------------------------------------------------------*/
 #if !_FS_READONLY
 static
-FRESULT sync_window (
-	FATFS* fs		/* File system object */
+void write_mirrors (
+	FATFS* fs,			/* File system object */
+	const BYTE* buff,	/* Sector data to be written */
+	DWORD wsect			/* Sector number in the first FAT */
 )
 {
-	DWORD wsect;
 	UINT nf;
 
 
+	for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
+		wsect += fs->fsize;
+		disk_write(fs->drv, buff, wsect, 1);
+	}
+}
+
+
+#if _FS_LAZYFAT
+static
+void jnl_add (
+	FATFS* fs,		/* File system object */
+	DWORD ofs		/* Sector offset in the FAT */
+)
+{
+	UINT i, k, n = fs->jnum;
+	DWORD d, dmin;
+
+
+	for (i = 0; i < n; i++) {		/* Is it in or next to a dirty region? */
+		if (ofs + 1 >= fs->jsect[i] && ofs <= fs->jend[i]) break;
+	}
+	if (i == n) {
+		if (n < _FS_LAZYFAT) {		/* Open a new region */
+			fs->jsect[n] = fs->jend[n] = ofs;
+			fs->jnum++;
+		} else {					/* Journal is full, stretch the nearest region */
+			dmin = 0xFFFFFFFF;
+			for (k = 0; k < n; k++) {
+				d = (ofs < fs->jsect[k]) ? fs->jsect[k] - ofs : ofs - fs->jend[k];
+				if (d < dmin) {
+					dmin = d; i = k;
+				}
+			}
+		}
+	}
+	if (ofs < fs->jsect[i]) fs->jsect[i] = ofs;
+	if (ofs >= fs->jend[i]) fs->jend[i] = ofs + 1;
+}
+#endif
+
+
+static
+FRESULT write_sector (	/* FR_OK: successful, FR_DISK_ERR: failed */
+	FATFS* fs,			/* File system object */
+	const BYTE* buff,	/* Sector data to be written */
+	DWORD wsect			/* Sector number */
+)
+{
+	if (disk_write(fs->drv, buff, wsect, 1))
+		return FR_DISK_ERR;
+	if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
+#if _FS_LAZYFAT
+		if (fs->n_fats >= 2) {					/* Defer the FAT copies until the checkpoint */
+			jnl_add(fs, wsect - fs->fatbase);
+			return FR_OK;
+		}
+#endif
+		write_mirrors(fs, buff, wsect);
+	}
+	return FR_OK;
+}
+
+
+static
+FRESULT sync_window (
+	FATFS* fs		/* File system object */
+)
+{
 	if (fs->wflag) {	/* Write back the sector if it is dirty */
-		wsect = fs->winsect;	/* Current sector number */
-		if (disk_write(fs->drv, fs->win, wsect, 1))
+		if (write_sector(fs, fs->win, fs->winsect) != FR_OK)
 			return FR_DISK_ERR;
 		fs->wflag = 0;
-		if (wsect - fs->fatbase < fs->fsize) {		/* Is it in the FAT area? */
-			for (nf = fs->n_fats; nf >= 2; nf--) {	/* Reflect the change to all FAT copies */
-				wsect += fs->fsize;
-				disk_write(fs->drv, fs->win, wsect, 1);
-			}
+	}
+	return FR_OK;
+}
+#endif
+
+
+#if _FS_WINDOWS >= 2
+static
+void park_init (
+	FATFS* fs		/* File system object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINDOWS - 1; i++) {	/* Blank all parking buffers */
+		fs->pwsect[i] = 0xFFFFFFFF;
+		fs->pwflag[i] = 0;
+		fs->pwage[i] = (BYTE)i;
+	}
+}
+
+
+#if !_FS_READONLY
+static
+void park_drop (
+	FATFS* fs,		/* File system object */
+	DWORD sect,		/* First sector to be discarded */
+	UINT cnt		/* Number of sectors */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINDOWS - 1; i++) {	/* Discard parked copies of the sectors without write-back */
+		if (fs->pwsect[i] - sect < cnt) {
+			fs->pwsect[i] = 0xFFFFFFFF;
+			fs->pwflag[i] = 0;
 		}
 	}
+}
+#endif
+
+
+static
+void park_touch (
+	FATFS* fs,		/* File system object */
+	UINT k			/* Parking buffer used at last */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINDOWS - 1; i++) {	/* Age the buffers used after it */
+		if (fs->pwage[i] < fs->pwage[k]) fs->pwage[i]++;
+	}
+	fs->pwage[k] = 0;
+}
+
+
+static
+UINT park_victim (	/* Index of the parking buffer to receive the sector */
+	FATFS* fs,		/* File system object */
+	DWORD sect		/* Sector to be parked */
+)
+{
+	UINT i, k;
+
+
+#if _FS_FATWIN
+	if (sect - fs->fatbase < fs->fsize)	/* FAT sectors go to the dedicated buffer */
+		return 0;
+	k = 1;
+#else
+	k = 0;
+	(void)sect;
+#endif
+	for (i = k; i < _FS_WINDOWS - 1; i++) {	/* Blank or least recently used buffer */
+		if (fs->pwsect[i] == 0xFFFFFFFF) return i;
+		if (fs->pwage[i] > fs->pwage[k]) k = i;
+	}
+	return k;
+}
+
+
+static
+FRESULT park_window (	/* FR_OK: successful, FR_DISK_ERR: failed */
+	FATFS* fs			/* File system object */
+)
+{
+	UINT v;
+
+
+	if (fs->winsect != 0xFFFFFFFF) {	/* Move the current window into a parking buffer */
+		v = park_victim(fs, fs->winsect);
+#if !_FS_READONLY
+		if ((fs->pwflag[v] & 1) && write_sector(fs, fs->pwin[v], fs->pwsect[v]) != FR_OK)
+			return FR_DISK_ERR;			/* Write back the evicted sector if it is dirty */
+#endif
+		mem_cpy(fs->pwin[v], fs->win, SS(fs));
+		fs->pwsect[v] = fs->winsect;
+		fs->pwflag[v] = fs->wflag;
+		park_touch(fs, v);
+		fs->winsect = 0xFFFFFFFF;
+		fs->wflag = 0;
+	}
 	return FR_OK;
 }
+
+
+#if !_FS_READONLY
+static
+FRESULT sync_parked (	/* FR_OK: successful, FR_DISK_ERR: failed */
+	FATFS* fs			/* File system object */
+)
+{
+	UINT i;
+
+
+	for (i = 0; i < _FS_WINDOWS - 1; i++) {	/* Write back dirty parking buffers */
+		if (fs->pwflag[i] & 1) {
+			if (write_sector(fs, fs->pwin[i], fs->pwsect[i]) != FR_OK)
+				return FR_DISK_ERR;
+			fs->pwflag[i] = 0;
+		}
+	}
+	return FR_OK;
+}
+#endif
 #endif
 
 
@@ -781,6 +1013,45 @@ FRESULT move_window (
 	DWORD sector	/* Sector number to make appearance in the fs->win[] */
 )
 {
+#if _FS_WINDOWS >= 2
+	UINT i, k;
+	BYTE b, *pw;
+	DWORD ws;
+
+
+	if (sector != fs->winsect) {	/* Changed current window */
+		for (k = 0; k < _FS_WINDOWS - 1 && fs->pwsect[k] != sector; k++) ;	/* Is the sector parked? */
+		if (k < _FS_WINDOWS - 1
+#if _FS_FATWIN
+			&& (fs->winsect == 0xFFFFFFFF		/* (the current window must fit in the same buffer) */
+			|| (sector - fs->fatbase < fs->fsize) == (fs->winsect - fs->fatbase < fs->fsize))
+#endif
+			) {
+			pw = fs->pwin[k];				/* Swap the window and the parked sector */
+			for (i = 0; i < SS(fs); i++) {
+				b = fs->win[i]; fs->win[i] = pw[i]; pw[i] = b;
+			}
+			ws = fs->winsect; fs->winsect = sector; fs->pwsect[k] = ws;
+			b = fs->wflag; fs->wflag = fs->pwflag[k]; fs->pwflag[k] = b;
+			park_touch(fs, k);
+			return FR_OK;
+		}
+		if (park_window(fs) != FR_OK)		/* Park the current window */
+			return FR_DISK_ERR;
+		if (k < _FS_WINDOWS - 1) {			/* Take the sector out of its parking buffer */
+			mem_cpy(fs->win, fs->pwin[k], SS(fs));
+			fs->wflag = fs->pwflag[k];
+			fs->pwsect[k] = 0xFFFFFFFF;
+			fs->pwflag[k] = 0;
+		} else {							/* Load the sector from the disk */
+			if (disk_read(fs->drv, fs->win, sector, 1)) {
+				fs->winsect = 0xFFFFFFFF;
+				return FR_DISK_ERR;
+			}
+		}
+		fs->winsect = sector;
+	}
+#else
 	if (sector != fs->winsect) {	/* Changed current window */
 #if !_FS_READONLY
 		if (sync_window(fs) != FR_OK)
@@ -790,6 +1061,7 @@ FRESULT move_window (
 			return FR_DISK_ERR;
 		fs->winsect = sector;
 	}
+#endif
 
 	return FR_OK;
 }
@@ -801,6 +1073,65 @@ FRESULT move_window (
 /* Synchronize file system and strage device                             */
 /*-----------------------------------------------------------------------*/
 #if !_FS_READONLY
+static
+void write_fsinfo (
+	FATFS* fs		/* File system object */
+)
+{
+	/* Update FSINFO sector if needed */
+	if (FSTYPE(fs) == FS_FAT32 && fs->fsi_flag == 1) {
+		/* Create FSINFO structure */
+		mem_set(fs->win, 0, SS(fs));
+		ST_WORD(fs->win+BS_55AA, 0xAA55);
+		ST_DWORD(fs->win+FSI_LeadSig, 0x41615252);
+		ST_DWORD(fs->win+FSI_StrucSig, 0x61417272);
+		ST_DWORD(fs->win+FSI_Free_Count, fs->free_clust);
+		ST_DWORD(fs->win+FSI_Nxt_Free, fs->last_clust);
+		/* Write it into the FSINFO sector */
+		fs->winsect = fs->volbase + 1;
+#if _FS_WINDOWS >= 2
+		park_drop(fs, fs->winsect, 1);
+#endif
+		disk_write(fs->drv, fs->win, fs->winsect, 1);
+		fs->fsi_flag = 0;
+	}
+}
+
+
+#if _FS_LAZYFAT
+static
+FRESULT checkpoint (	/* FR_OK: successful, FR_DISK_ERR: failed */
+	FATFS* fs		/* File system object */
+)
+{
+	FRESULT res;
+	DWORD sect;
+	UINT i;
+
+
+	res = sync_window(fs);
+#if _FS_WINDOWS >= 2
+	if (res == FR_OK)
+		res = sync_parked(fs);
+#endif
+	for (i = 0; res == FR_OK && i < fs->jnum; i++) {	/* Copy the dirty FAT regions to the FAT copies */
+		for (sect = fs->jsect[i]; sect < fs->jend[i]; sect++) {
+			res = move_window(fs, fs->fatbase + sect);
+			if (res != FR_OK) break;
+			write_mirrors(fs, fs->win, fs->winsect);
+		}
+	}
+	if (res == FR_OK) {
+		write_fsinfo(fs);
+		fs->jnum = 0;
+		fs->jsyncs = 0;
+	}
+
+	return res;
+}
+#endif
+
+
 static
 FRESULT sync_fs (	/* FR_OK: successful, FR_DISK_ERR: failed */
 	FATFS* fs		/* File system object */
@@ -810,21 +1141,20 @@ FRESULT sync_fs (	/* FR_OK: successful, FR_DISK_ERR: failed */
 
 
 	res = sync_window(fs);
+#if _FS_WINDOWS >= 2
+	if (res == FR_OK)
+		res = sync_parked(fs);
+#endif
 	if (res == FR_OK) {
-		/* Update FSINFO sector if needed */
-		if (fs->fs_type == FS_FAT32 && fs->fsi_flag == 1) {
-			/* Create FSINFO structure */
-			mem_set(fs->win, 0, SS(fs));
-			ST_WORD(fs->win+BS_55AA, 0xAA55);
-			ST_DWORD(fs->win+FSI_LeadSig, 0x41615252);
-			ST_DWORD(fs->win+FSI_StrucSig, 0x61417272);
-			ST_DWORD(fs->win+FSI_Free_Count, fs->free_clust);
-			ST_DWORD(fs->win+FSI_Nxt_Free, fs->last_clust);
-			/* Write it into the FSINFO sector */
-			fs->winsect = fs->volbase + 1;
-			disk_write(fs->drv, fs->win, fs->winsect, 1);
-			fs->fsi_flag = 0;
-		}
+#if _FS_LAZYFAT
+#if _FS_CHECKPOINT
+		/* Update the FAT copies and FSINFO sector at the checkpoint */
+		if ((fs->jnum || fs->fsi_flag == 1) && ++fs->jsyncs >= _FS_CHECKPOINT)
+			res = checkpoint(fs);
+#endif
+#else
+		write_fsinfo(fs);
+#endif
 		/* Make sure that no pending write process in the physical drive */
 		if (disk_ioctl(fs->drv, CTRL_SYNC, 0) != RES_OK)
 			res = FR_DISK_ERR;
@@ -849,7 +1179,7 @@ DWORD clust2sect (	/* !=0: Sector number, 0: Failed - invalid cluster# */
 {
 	clst -= 2;
 	if (clst >= (fs->n_fatent - 2)) return 0;		/* Invalid cluster# */
-	return clst * fs->csize + fs->database;
+	return (clst << fs->csshift) + fs->database;
 }
 
 
@@ -872,23 +1202,23 @@ DWORD get_fat (	/* 0xFFFFFFFF:Disk error, 1:Internal error, Else:Cluster status
 	if (clst < 2 || clst >= fs->n_fatent)	/* Check range */
 		return 1;
 
-	switch (fs->fs_type) {
+	switch (FSTYPE(fs)) {
 	case FS_FAT12 :
 		bc = (UINT)clst; bc += bc / 2;
-		if (move_window(fs, fs->fatbase + (bc / SS(fs)))) break;
-		wc = fs->win[bc % SS(fs)]; bc++;
-		if (move_window(fs, fs->fatbase + (bc / SS(fs)))) break;
-		wc |= fs->win[bc % SS(fs)] << 8;
+		if (move_window(fs, fs->fatbase + (bc >> SSHIFT(fs)))) break;
+		wc = fs->win[bc & (SS(fs) - 1)]; bc++;
+		if (move_window(fs, fs->fatbase + (bc >> SSHIFT(fs)))) break;
+		wc |= fs->win[bc & (SS(fs) - 1)] << 8;
 		return clst & 1 ? wc >> 4 : (wc & 0xFFF);
 
 	case FS_FAT16 :
-		if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)))) break;
-		p = &fs->win[clst * 2 % SS(fs)];
+		if (move_window(fs, fs->fatbase + (clst >> (SSHIFT(fs) - 1)))) break;
+		p = &fs->win[(UINT)clst * 2 & (SS(fs) - 1)];
 		return LD_WORD(p);
 
 	case FS_FAT32 :
-		if (move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)))) break;
-		p = &fs->win[clst * 4 % SS(fs)];
+		if (move_window(fs, fs->fatbase + (clst >> (SSHIFT(fs) - 2)))) break;
+		p = &fs->win[(UINT)clst * 4 & (SS(fs) - 1)];
 		return LD_DWORD(p) & 0x0FFFFFFF;
 
 	default:
@@ -921,32 +1251,32 @@ FRESULT put_fat (
 		res = FR_INT_ERR;
 
 	} else {
-		switch (fs->fs_type) {
+		switch (FSTYPE(fs)) {
 		case FS_FAT12 :
 			bc = (UINT)clst; bc += bc / 2;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
+			res = move_window(fs, fs->fatbase + (bc >> SSHIFT(fs)));
 			if (res != FR_OK) break;
-			p = &fs->win[bc % SS(fs)];
+			p = &fs->win[bc & (SS(fs) - 1)];
 			*p = (clst & 1) ? ((*p & 0x0F) | ((BYTE)val << 4)) : (BYTE)val;
 			bc++;
 			fs->wflag = 1;
-			res = move_window(fs, fs->fatbase + (bc / SS(fs)));
+			res = move_window(fs, fs->fatbase + (bc >> SSHIFT(fs)));
 			if (res != FR_OK) break;
-			p = &fs->win[bc % SS(fs)];
+			p = &fs->win[bc & (SS(fs) - 1)];
 			*p = (clst & 1) ? (BYTE)(val >> 4) : ((*p & 0xF0) | ((BYTE)(val >> 8) & 0x0F));
 			break;
 
 		case FS_FAT16 :
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 2)));
+			res = move_window(fs, fs->fatbase + (clst >> (SSHIFT(fs) - 1)));
 			if (res != FR_OK) break;
-			p = &fs->win[clst * 2 % SS(fs)];
+			p = &fs->win[(UINT)clst * 2 & (SS(fs) - 1)];
 			ST_WORD(p, (WORD)val);
 			break;
 
 		case FS_FAT32 :
-			res = move_window(fs, fs->fatbase + (clst / (SS(fs) / 4)));
+			res = move_window(fs, fs->fatbase + (clst >> (SSHIFT(fs) - 2)));
 			if (res != FR_OK) break;
-			p = &fs->win[clst * 4 % SS(fs)];
+			p = &fs->win[(UINT)clst * 4 & (SS(fs) - 1)];
 			val |= LD_DWORD(p) & 0xF0000000;
 			ST_DWORD(p, val);
 			break;
@@ -955,6 +1285,12 @@ FRESULT put_fat (
 			res = FR_INT_ERR;
 		}
 		fs->wflag = 1;
+#if _FS_FREEMAP
+		if (res == FR_OK && val == 0 && fs->fmshift) {	/* The part of the FAT has a free cluster now */
+			clst >>= fs->fmshift;
+			fs->fmap[clst / 8] |= 1 << (clst % 8);
+		}
+#endif
 	}
 
 	return res;
@@ -1029,6 +1365,10 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 {
 	DWORD cs, ncl, scl;
 	FRESULT res;
+#if _FS_FREEMAP
+	DWORD pm = 0, pi = 0;
+	BYTE full = 0;
+#endif
 
 
 	if (clst == 0) {		/* Create a new chain */
@@ -1043,6 +1383,9 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 		scl = clst;
 	}
 
+#if _FS_FREEMAP
+	if (fs->fmshift) pm = ((DWORD)1 << fs->fmshift) - 1;	/* Mask of cluster index in a part of the FAT */
+#endif
 	ncl = scl;				/* Start cluster */
 	for (;;) {
 		ncl++;							/* Next cluster */
@@ -1050,11 +1393,27 @@ DWORD create_chain (	/* 0:No free cluster, 1:Internal error, 0xFFFFFFFF:Disk err
 			ncl = 2;
 			if (ncl > scl) return 0;	/* No free cluster */
 		}
+#if _FS_FREEMAP
+		if (pm && (ncl == scl + 1 || ncl == 2 || !(ncl & pm))) {	/* Entered a part of the FAT */
+			pi = ncl >> fs->fmshift;
+			if (!(fs->fmap[pi / 8] & (1 << (pi % 8)))) {	/* Skip it if it has no free cluster */
+				cs = (pi + 1) << fs->fmshift;	/* Top of the next part */
+				if (scl >= ncl && scl < cs) return 0;	/* No free cluster */
+				ncl = cs - 1;
+				continue;
+			}
+			full = (ncl == 2 || !(ncl & pm));	/* Scanning the part from its top? */
+		}
+#endif
 		cs = get_fat(fs, ncl);			/* Get the cluster status */
 		if (cs == 0) break;				/* Found a free cluster */
 		if (cs == 0xFFFFFFFF || cs == 1)/* An error occurred */
 			return cs;
 		if (ncl == scl) return 0;		/* No free cluster */
+#if _FS_FREEMAP
+		if (full && (!((ncl + 1) & pm) || ncl + 1 >= fs->n_fatent))	/* Whole part scanned without a free cluster */
+			fs->fmap[pi / 8] &= ~(1 << (pi % 8));
+#endif
 	}
 
 	res = put_fat(fs, ncl, 0x0FFFFFFF);	/* Mark the new cluster "last link" */
@@ -1093,7 +1452,7 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 
 
 	tbl = fp->cltbl + 1;	/* Top of CLMT */
-	cl = ofs / SS(fp->fs) / fp->fs->csize;	/* Cluster order from top of the file */
+	cl = ofs >> (SSHIFT(fp->fs) + fp->fs->csshift);	/* Cluster order from top of the file */
 	for (;;) {
 		ncl = *tbl++;			/* Number of cluters in the fragment */
 		if (!ncl) return 0;		/* End of table? (error) */
@@ -1102,6 +1461,26 @@ DWORD clmt_clust (	/* <2:Error, >=2:Cluster number */
 	}
 	return cl + *tbl;	/* Return the cluster number */
 }
+
+
+#if !_FS_READONLY
+static
+void clmt_stretch (
+	FIL* fp,		/* Pointer to the file object */
+	DWORD ncl		/* Cluster# appended to the file */
+)
+{
+	DWORD *tbl, *ft = 0;
+
+
+	for (tbl = fp->cltbl + 1; *tbl; tbl += 2)	/* Find the last fragment */
+		ft = tbl;
+	if (ft && ft[0] + ft[1] == ncl)
+		ft[0]++;		/* Contiguous cluster, stretch the last fragment */
+	else
+		fp->cltbl = 0;	/* New fragment cannot be added, return to normal seek mode */
+}
+#endif
 #endif	/* _USE_FASTSEEK */
 
 
@@ -1125,7 +1504,7 @@ FRESULT dir_sdi (
 	clst = dp->sclust;		/* Table start cluster (0:root) */
 	if (clst == 1 || clst >= dp->fs->n_fatent)	/* Check start cluster range */
 		return FR_INT_ERR;
-	if (!clst && dp->fs->fs_type == FS_FAT32)	/* Replace cluster# 0 with root cluster# if in FAT32 */
+	if (!clst && FSTYPE(dp->fs) == FS_FAT32)	/* Replace cluster# 0 with root cluster# if in FAT32 */
 		clst = dp->fs->dirbase;
 
 	if (clst == 0) {	/* Static table (root-directory in FAT12/16) */
@@ -1134,7 +1513,7 @@ FRESULT dir_sdi (
 		sect = dp->fs->dirbase;
 	}
 	else {				/* Dynamic table (root-directory in FAT32 or sub-directory) */
-		ic = SS(dp->fs) / SZ_DIR * dp->fs->csize;	/* Entries per cluster */
+		ic = SS(dp->fs) / SZ_DIR << dp->fs->csshift;	/* Entries per cluster */
 		while (idx >= ic) {	/* Follow cluster chain */
 			clst = get_fat(dp->fs, clst);				/* Get next cluster */
 			if (clst == 0xFFFFFFFF) return FR_DISK_ERR;	/* Disk error */
@@ -1197,6 +1576,9 @@ FRESULT dir_next (	/* FR_OK:Succeeded, FR_NO_FILE:End of table, FR_DENIED:Could
 					if (sync_window(dp->fs)) return FR_DISK_ERR;/* Flush disk access window */
 					mem_set(dp->fs->win, 0, SS(dp->fs));		/* Clear window buffer */
 					dp->fs->winsect = clust2sect(dp->fs, clst);	/* Cluster start sector */
+#if _FS_WINDOWS >= 2
+					park_drop(dp->fs, dp->fs->winsect, dp->fs->csize);	/* Discard stale copies of the cluster */
+#endif
 					for (c = 0; c < dp->fs->csize; c++) {		/* Fill the new cluster with 0 */
 						dp->fs->wflag = 1;
 						if (sync_window(dp->fs)) return FR_DISK_ERR;
@@ -1273,7 +1655,7 @@ DWORD ld_clust (
 	DWORD cl;
 
 	cl = LD_WORD(dir+DIR_FstClusLO);
-	if (fs->fs_type == FS_FAT32)
+	if (FSTYPE(fs) == FS_FAT32)
 		cl |= (DWORD)LD_WORD(dir+DIR_FstClusHI) << 16;
 
 	return cl;
@@ -1883,7 +2265,7 @@ FRESULT create_name (
 		if (w >= 0x80) {				/* Non ASCII character */
 #ifdef _EXCVT
 			w = ff_convert(w, 0);		/* Unicode -> OEM code */
-			if (w) w = ExCvt[w - 0x80];	/* Convert extended character to upper (SBCS) */
+			if (w) w = EXCVT(w);	/* Convert extended character to upper (SBCS) */
 #else
 			w = ff_convert(ff_wtoupper(w), 0);	/* Upper converted Unicode -> OEM code */
 #endif
@@ -1960,7 +2342,7 @@ FRESULT create_name (
 		if (c >= 0x80) {				/* Extended character? */
 			b |= 3;						/* Eliminate NT flag */
 #ifdef _EXCVT
-			c = ExCvt[c - 0x80];		/* To upper extended characters (SBCS cfg) */
+			c = EXCVT(c);		/* To upper extended characters (SBCS cfg) */
 #else
 #if !_DF1S
 			return FR_INVALID_NAME;		/* Reject extended characters (ASCII cfg) */
@@ -2137,6 +2519,9 @@ BYTE check_fs (	/* 0:FAT boor sector, 1:Valid boor sector but not FAT, 2:Not a b
 )
 {
 	fs->wflag = 0; fs->winsect = 0xFFFFFFFF;	/* Invaidate window */
+#if _FS_WINDOWS >= 2
+	park_init(fs);								/* Invalidate parking buffers */
+#endif
 	if (move_window(fs, sect) != FR_OK)			/* Load boot record */
 		return 3;
 
@@ -2154,6 +2539,36 @@ BYTE check_fs (	/* 0:FAT boor sector, 1:Valid boor sector but not FAT, 2:Not a b
 
 
 
+#if _FS_QUICKMOUNT
+static
+int chk_mounted (	/* 1:The boot sector in the win[] is of the last mounted volume, 0:Another volume */
+	FATFS* fs	/* File system object */
+)
+{
+	DWORD fasize, tsect, sysect;
+
+
+	fasize = LD_WORD(fs->win+BPB_FATSz16);
+	if (!fasize) fasize = LD_DWORD(fs->win+BPB_FATSz32);
+	tsect = LD_WORD(fs->win+BPB_TotSec16);
+	if (!tsect) tsect = LD_DWORD(fs->win+BPB_TotSec32);
+	sysect = fs->database - fs->volbase;
+
+	return LD_WORD(fs->win+BPB_BytsPerSec) == SS(fs)
+		&& fs->win[BPB_SecPerClus] == fs->csize
+		&& fs->win[BPB_NumFATs] == fs->n_fats
+		&& fasize == fs->fsize
+		&& LD_WORD(fs->win+BPB_RootEntCnt) == fs->n_rootdir
+		&& fs->volbase + LD_WORD(fs->win+BPB_RsvdSecCnt) == fs->fatbase
+		&& tsect >= sysect && ((tsect - sysect) >> fs->csshift) + 2 == fs->n_fatent
+		&& (fs->mtype != FS_FAT32 || LD_DWORD(fs->win+BPB_RootClus) == fs->dirbase)
+		&& LD_DWORD(fs->win + (fs->mtype == FS_FAT32 ? BS_VolID32 : BS_VolID)) == fs->vsn;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Find logical drive and check if the volume is mounted                 */
 /*-----------------------------------------------------------------------*/
@@ -2171,6 +2586,13 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	DWORD bsect, fasize, tsect, sysect, nclst, szbfat;
 	WORD nrsv;
 	FATFS *fs;
+#if _FS_LAZYFAT
+	BYTE keep;
+	DWORD ofatbase;
+#endif
+#if _FS_QUICKMOUNT || _FS_LAZYFAT
+	DWORD vsn;
+#endif
 
 
 	/* Get logical drive number from the path name */
@@ -2198,15 +2620,38 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	/* Following code attempts to mount the volume. (analyze BPB and initialize the fs object) */
 
 	fs->fs_type = 0;					/* Clear the file system object */
+#if _FS_LAZYFAT
+	ofatbase = fs->fatbase;				/* (to find if the deferred updates belong to this volume) */
+#endif
 	fs->drv = LD2PD(vol);				/* Bind the logical drive and a physical drive */
 	stat = disk_initialize(fs->drv);	/* Initialize the physical drive */
-	if (stat & STA_NOINIT)				/* Check if the initialization succeeded */
+	if (stat & STA_NOINIT) {			/* Check if the initialization succeeded */
+#if _FS_QUICKMOUNT
+		fs->mtype = 0;					/* (the medium may be changed before it comes back) */
+#endif
 		return FR_NOT_READY;			/* Failed to initialize due to no medium or hard error */
+	}
 	if (!_FS_READONLY && wmode && (stat & STA_PROTECT))	/* Check disk write protection if needed */
 		return FR_WRITE_PROTECTED;
 #if _MAX_SS != _MIN_SS						/* Get sector size (multiple sector size cfg only) */
 	if (disk_ioctl(fs->drv, GET_SECTOR_SIZE, &SS(fs)) != RES_OK
-		|| SS(fs) < _MIN_SS || SS(fs) > _MAX_SS) return FR_DISK_ERR;
+		|| SS(fs) < _MIN_SS || SS(fs) > _MAX_SS || (SS(fs) & (SS(fs) - 1))) return FR_DISK_ERR;
+	for (fs->sshift = 9; (1U << fs->sshift) < SS(fs); fs->sshift++) ;	/* Sector size in log2 */
+#endif
+#if _FS_QUICKMOUNT
+	/* Quick remount: the same volume is validated with its boot sector only */
+	if (fs->mtype && check_fs(fs, fs->volbase) == 0 && chk_mounted(fs)) {
+		fs->fs_type = fs->mtype;	/* The object keeps the geometry and cluster allocation information */
+		fs->id = ++Fsid;
+#if _FS_RPATH
+		fs->cdir = 0;
+#endif
+#if _FS_LOCK
+		clear_lock(fs);
+#endif
+		return FR_OK;
+	}
+	fs->mtype = 0;					/* The volume is analyzed again */
 #endif
 	/* Find an FAT partition on the drive. Supports only generic partitioning, FDISK and SFD. */
 	bsect = 0;
@@ -2246,6 +2691,7 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	fs->csize = fs->win[BPB_SecPerClus];				/* Number of sectors per cluster */
 	if (!fs->csize || (fs->csize & (fs->csize - 1)))	/* (Must be power of 2) */
 		return FR_NO_FILESYSTEM;
+	for (fs->csshift = 0; (1 << fs->csshift) < fs->csize; fs->csshift++) ;	/* Sectors per cluster in log2 */
 
 	fs->n_rootdir = LD_WORD(fs->win+BPB_RootEntCnt);	/* Number of root directory entries */
 	if (fs->n_rootdir % (SS(fs) / SZ_DIR))				/* (Must be sector aligned) */
@@ -2260,11 +2706,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	/* Determine the FAT sub type */
 	sysect = nrsv + fasize + fs->n_rootdir / (SS(fs) / SZ_DIR);	/* RSV+FAT+DIR */
 	if (tsect < sysect) return FR_NO_FILESYSTEM;		/* (Invalid volume size) */
-	nclst = (tsect - sysect) / fs->csize;				/* Number of clusters */
+	nclst = (tsect - sysect) >> fs->csshift;			/* Number of clusters */
 	if (!nclst) return FR_NO_FILESYSTEM;				/* (Invalid volume size) */
 	fmt = FS_FAT12;
 	if (nclst >= MIN_FAT16) fmt = FS_FAT16;
 	if (nclst >= MIN_FAT32) fmt = FS_FAT32;
+#if _FS_ONLYFAT
+	if (fmt != FSTYPE(fs)) return FR_NO_FILESYSTEM;	/* (The FAT sub-type is not supported at this cfg) */
+	fmt = FSTYPE(fs);
+#endif
 
 	/* Boundaries and Limits */
 	fs->n_fatent = nclst + 2;							/* Number of FAT entries */
@@ -2284,7 +2734,30 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 	if (fs->fsize < (szbfat + (SS(fs) - 1)) / SS(fs))	/* (BPB_FATSz must not be less than needed) */
 		return FR_NO_FILESYSTEM;
 
+#if _FS_QUICKMOUNT || _FS_LAZYFAT
+	vsn = LD_DWORD(fs->win + (fmt == FS_FAT32 ? BS_VolID32 : BS_VolID));	/* Volume serial number */
+#endif
+
 #if !_FS_READONLY
+#if _FS_FREEMAP
+	/* Initialize free cluster map, any part of the FAT may have a free cluster */
+	mem_set(fs->fmap, 0xFF, _FS_FREEMAP);
+	fs->fmshift = 0;
+	if (fmt != FS_FAT12) {
+		for (nclst = SS(fs) / (fmt == FS_FAT32 ? 4 : 2); nclst > 1; nclst >>= 1)	/* At least a sector per bit */
+			fs->fmshift++;
+		while (((DWORD)_FS_FREEMAP * 8 << fs->fmshift) < fs->n_fatent)
+			fs->fmshift++;
+	}
+#endif
+
+#if _FS_LAZYFAT
+	/* Keep the deferred updates and cluster allocation information if the same volume is mounted again */
+	keep = (fs->jnum || fs->fsi_flag == 1) && fs->vsn == vsn && fs->fatbase == ofatbase;
+	if (!keep)							/* Another volume, its FAT copies are left to the disk checker */
+		fs->jnum = fs->jsyncs = 0;
+	if (!keep) {
+#endif
 	/* Initialize cluster allocation information */
 	fs->last_clust = fs->free_clust = 0xFFFFFFFF;
 
@@ -2309,6 +2782,15 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 		}
 	}
 #endif
+#if _FS_LAZYFAT
+	}
+#endif
+#endif
+#if _FS_QUICKMOUNT || _FS_LAZYFAT
+	fs->vsn = vsn;		/* Volume serial number */
+#endif
+#if _FS_QUICKMOUNT
+	fs->mtype = fmt;	/* Validate the geometry for quick remount */
 #endif
 	fs->fs_type = fmt;	/* FAT sub-type */
 	fs->id = ++Fsid;	/* File system mount ID */
@@ -2366,7 +2848,7 @@ FRESULT validate (	/* FR_OK(0): The object is valid, !=0: Invalid */
 FRESULT f_mount (
 	FATFS* fs,			/* Pointer to the file system object (NULL:unmount)*/
 	const TCHAR* path,	/* Logical drive number to be mounted/unmounted */
-	BYTE opt			/* 0:Do not mount (delayed mount), 1:Mount immediately */
+	BYTE opt			/* 0:Do not mount (delayed mount), 1:Mount immediately (unmount: 1:Make deferred updates) */
 )
 {
 	FATFS *cfs;
@@ -2379,7 +2861,17 @@ FRESULT f_mount (
 	if (vol < 0) return FR_INVALID_DRIVE;
 	cfs = FatFs[vol];					/* Pointer to fs object */
 
+	res = FR_OK;
 	if (cfs) {
+#if _FS_LAZYFAT
+		if (!fs && opt == 1 && cfs->fs_type				/* Clean unmount, make the deferred updates */
+			&& (cfs->jnum || cfs->fsi_flag == 1)
+			&& !(disk_status(cfs->drv) & STA_NOINIT)) {
+			res = checkpoint(cfs);
+			if (disk_ioctl(cfs->drv, CTRL_SYNC, 0) != RES_OK)
+				res = FR_DISK_ERR;
+		}
+#endif
 #if _FS_LOCK
 		clear_lock(cfs);
 #endif
@@ -2397,7 +2889,7 @@ FRESULT f_mount (
 	}
 	FatFs[vol] = fs;					/* Register new fs object */
 
-	if (!fs || opt != 1) return FR_OK;	/* Do not mount now, it will be mounted later */
+	if (!fs || opt != 1) return res;	/* Do not mount now, it will be mounted later */
 
 	res = find_volume(&fs, &path, 0);	/* Force mounted the volume */
 	LEAVE_FF(fs, res);
@@ -2541,6 +3033,77 @@ FRESULT f_open (
 
 
 
+#if _USE_OPENLOC
+/*-----------------------------------------------------------------------*/
+/* Open a File at the Remembered Directory Entry                         */
+/*-----------------------------------------------------------------------*/
+
+FRESULT f_openloc (
+	FIL* fp,			/* Pointer to the blank file object */
+	const TCHAR* path,	/* Pointer to the file name */
+	BYTE mode,			/* Access mode and file open mode flags */
+	FILOC* loc			/* Pointer to the directory entry location (in/out) */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	BYTE *dir;
+	const TCHAR *p = path;
+
+
+	if (!fp || !loc) return FR_INVALID_OBJECT;
+
+	if (loc->sect && loc->index < _MAX_SS / SZ_DIR && !(mode & (FA_CREATE_ALWAYS | FA_CREATE_NEW))) {
+		fp->fs = 0;			/* Clear file object */
+		mode &= FA_READ | FA_WRITE;
+		res = find_volume(&fs, &p, (BYTE)(mode & ~FA_READ));
+		if (res == FR_OK)
+			res = move_window(fs, loc->sect);	/* Load the remembered directory sector */
+		if (res != FR_OK) LEAVE_FF(fs, res);
+
+		dir = fs->win + loc->index * SZ_DIR;
+		if (!mem_cmp(dir, loc->name, 11)		/* Validate the entry by its SFN and start cluster */
+			&& ld_clust(fs, dir) == loc->sclust
+			&& !(dir[DIR_Attr] & AM_DIR)
+			&& (!(mode & FA_WRITE) || !(dir[DIR_Attr] & AM_RDO))) {
+			fp->dir_sect = loc->sect;			/* Pointer to the directory entry */
+			fp->dir_ptr = dir;
+			fp->flag = mode;					/* File access mode */
+			fp->err = 0;						/* Clear error flag */
+			fp->sclust = loc->sclust;			/* File start cluster */
+			fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
+			fp->fptr = 0;						/* File pointer */
+			fp->dsect = 0;
+#if _USE_FASTSEEK
+			fp->cltbl = 0;						/* Normal seek mode */
+#endif
+			fp->fs = fs;	 					/* Validate file object */
+			fp->id = fs->id;
+			LEAVE_FF(fs, FR_OK);
+		}
+#if _FS_REENTRANT
+		unlock_fs(fs, FR_OK);
+#endif
+	}
+
+	res = f_open(fp, path, mode);		/* Follow the path and remember the entry found */
+	if (res == FR_OK) {
+		fs = fp->fs;
+		loc->sect = fp->dir_sect;
+		loc->index = (WORD)((fp->dir_ptr - fs->win) / SZ_DIR);
+		mem_cpy(loc->name, fp->dir_ptr, 11);
+		loc->sclust = fp->sclust;
+	} else {
+		loc->sect = 0;
+	}
+
+	return res;
+}
+#endif
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Read File                                                             */
 /*-----------------------------------------------------------------------*/
@@ -2555,6 +3118,9 @@ FRESULT f_read (
 	FRESULT res;
 	DWORD clst, sect, remain;
 	UINT rcnt, cc;
+#if !_FS_READONLY && _FS_MINIMIZE <= 2 && _FS_TINY && _FS_WINDOWS >= 2
+	UINT i;
+#endif
 	BYTE csect, *rbuff = (BYTE*)buff;
 
 
@@ -2601,6 +3167,12 @@ FRESULT f_read (
 #if _FS_TINY
 				if (fp->fs->wflag && fp->fs->winsect - sect < cc)
 					mem_cpy(rbuff + ((fp->fs->winsect - sect) * SS(fp->fs)), fp->fs->win, SS(fp->fs));
+#if _FS_WINDOWS >= 2
+				for (i = 0; i < _FS_WINDOWS - 1; i++) {
+					if ((fp->fs->pwflag[i] & 1) && fp->fs->pwsect[i] - sect < cc)
+						mem_cpy(rbuff + ((fp->fs->pwsect[i] - sect) * SS(fp->fs)), fp->fs->pwin[i], SS(fp->fs));
+				}
+#endif
 #else
 				if ((fp->flag & FA__DIRTY) && fp->dsect - sect < cc)
 					mem_cpy(rbuff + ((fp->dsect - sect) * SS(fp->fs)), fp->buf, SS(fp->fs));
@@ -2677,13 +3249,23 @@ FRESULT f_write (
 			if (!csect) {					/* On the cluster boundary? */
 				if (fp->fptr == 0) {		/* On the top of the file? */
 					clst = fp->sclust;		/* Follow from the origin */
-					if (clst == 0)			/* When no cluster is allocated, */
+					if (clst == 0) {		/* When no cluster is allocated, */
 						fp->sclust = clst = create_chain(fp->fs, 0);	/* Create a new cluster chain */
+#if _USE_FASTSEEK
+						if (fp->cltbl && clst >= 2 && clst != 0xFFFFFFFF)
+							clmt_stretch(fp, clst);	/* Record it in the CLMT */
+#endif
+					}
 				} else {					/* Middle or end of the file */
 #if _USE_FASTSEEK
-					if (fp->cltbl)
+					if (fp->cltbl) {
 						clst = clmt_clust(fp, fp->fptr);	/* Get cluster# from the CLMT */
-					else
+						if (clst == 0) {					/* Beyond the CLMT, stretch cluster chain on the FAT */
+							clst = create_chain(fp->fs, fp->clust);
+							if (clst >= 2 && clst != 0xFFFFFFFF)
+								clmt_stretch(fp, clst);		/* and record the new cluster in the CLMT */
+						}
+					} else
 #endif
 						clst = create_chain(fp->fs, fp->clust);	/* Follow or stretch cluster chain on the FAT */
 				}
@@ -2717,6 +3299,9 @@ FRESULT f_write (
 					mem_cpy(fp->fs->win, wbuff + ((fp->fs->winsect - sect) * SS(fp->fs)), SS(fp->fs));
 					fp->fs->wflag = 0;
 				}
+#if _FS_WINDOWS >= 2
+				park_drop(fp->fs, sect, cc);	/* Parked copies are overwritten as well */
+#endif
 #else
 				if (fp->dsect - sect < cc) { /* Refill sector cache if it gets invalidated by the direct write */
 					mem_cpy(fp->buf, wbuff + ((fp->dsect - sect) * SS(fp->fs)), SS(fp->fs));
@@ -2729,7 +3314,14 @@ FRESULT f_write (
 			}
 #if _FS_TINY
 			if (fp->fptr >= fp->fsize) {	/* Avoid silly cache filling at growing edge */
+#if _FS_WINDOWS >= 2
+				if (fp->fs->winsect != sect) {	/* Keep the FAT/directory sector cached */
+					if (park_window(fp->fs)) ABORT(fp->fs, FR_DISK_ERR);
+					park_drop(fp->fs, sect, 1);
+				}
+#else
 				if (sync_window(fp->fs)) ABORT(fp->fs, FR_DISK_ERR);
+#endif
 				fp->fs->winsect = sect;
 			}
 #else
@@ -3061,6 +3653,7 @@ FRESULT f_lseek (
 	/* Normal Seek */
 	{
 		DWORD clst, bcs, nsect, ifptr;
+		BYTE bcsh;
 
 		if (ofs > fp->fsize					/* In read-only mode, clip offset with the file size */
 #if !_FS_READONLY
@@ -3071,9 +3664,10 @@ FRESULT f_lseek (
 		ifptr = fp->fptr;
 		fp->fptr = nsect = 0;
 		if (ofs) {
-			bcs = (DWORD)fp->fs->csize * SS(fp->fs);	/* Cluster size (byte) */
+			bcsh = SSHIFT(fp->fs) + fp->fs->csshift;	/* Cluster size (byte) */
+			bcs = (DWORD)1 << bcsh;
 			if (ifptr > 0 &&
-				(ofs - 1) / bcs >= (ifptr - 1) / bcs) {	/* When seek to same or following cluster, */
+				(ofs - 1) >> bcsh >= (ifptr - 1) >> bcsh) {	/* When seek to same or following cluster, */
 				fp->fptr = (ifptr - 1) & ~(bcs - 1);	/* start from the current cluster */
 				ofs -= fp->fptr;
 				clst = fp->clust;
@@ -3333,7 +3927,7 @@ FRESULT f_getfree (
 			*nclst = fs->free_clust;
 		} else {
 			/* Get number of free clusters */
-			fat = fs->fs_type;
+			fat = FSTYPE(fs);
 			n = 0;
 			if (fat == FS_FAT12) {
 				clst = 2;
@@ -3542,9 +4136,12 @@ FRESULT f_mkdir (
 				st_clust(dir, dcl);
 				mem_cpy(dir+SZ_DIR, dir, SZ_DIR); 	/* Create ".." entry */
 				dir[SZ_DIR+1] = '.'; pcl = dj.sclust;
-				if (dj.fs->fs_type == FS_FAT32 && pcl == dj.fs->dirbase)
+				if (FSTYPE(dj.fs) == FS_FAT32 && pcl == dj.fs->dirbase)
 					pcl = 0;
 				st_clust(dir+SZ_DIR, pcl);
+#if _FS_WINDOWS >= 2
+				park_drop(dj.fs, dsc, dj.fs->csize);	/* Discard stale copies of the cluster */
+#endif
 				for (n = dj.fs->csize; n; n--) {	/* Write dot entries and clear following sectors */
 					dj.fs->winsect = dsc++;
 					dj.fs->wflag = 1;
@@ -3713,7 +4310,7 @@ FRESULT f_rename (
 								res = move_window(djo.fs, dw);
 								dir = djo.fs->win+SZ_DIR;	/* .. entry */
 								if (res == FR_OK && dir[1] == '.') {
-									dw = (djo.fs->fs_type == FS_FAT32 && djn.sclust == djo.fs->dirbase) ? 0 : djn.sclust;
+									dw = (FSTYPE(djo.fs) == FS_FAT32 && djn.sclust == djo.fs->dirbase) ? 0 : djn.sclust;
 									st_clust(dir, dw);
 									djo.fs->wflag = 1;
 								}
@@ -3797,7 +4394,7 @@ FRESULT f_getlabel (
 	if (res == FR_OK && sn) {
 		res = move_window(dj.fs, dj.fs->volbase);
 		if (res == FR_OK) {
-			i = dj.fs->fs_type == FS_FAT32 ? BS_VolID32 : BS_VolID;
+			i = FSTYPE(dj.fs) == FS_FAT32 ? BS_VolID32 : BS_VolID;
 			*sn = LD_DWORD(&dj.fs->win[i]);
 		}
 	}
@@ -3846,7 +4443,7 @@ FRESULT f_setlabel (
 #else
 			if (IsLower(w)) w -= 0x20;			/* To upper ASCII characters */
 #ifdef _EXCVT
-			if (w >= 0x80) w = ExCvt[w - 0x80];	/* To upper extended characters (SBCS cfg) */
+			if (w >= 0x80) w = EXCVT(w);	/* To upper extended characters (SBCS cfg) */
 #else
 			if (!_DF1S && w >= 0x80) w = 0;		/* Reject extended characters (ASCII cfg) */
 #endif
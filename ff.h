@@ -78,6 +78,7 @@ typedef struct {
 	BYTE	fs_type;		/* FAT sub-type (0:Not mounted) */
 	BYTE	drv;			/* Physical drive number */
 	BYTE	csize;			/* Sectors per cluster (1,2,4...128) */
+	BYTE	csshift;		/* Sectors per cluster in log2 (0..7) */
 	BYTE	n_fats;			/* Number of FAT copies (1 or 2) */
 	BYTE	wflag;			/* win[] flag (b0:dirty) */
 	BYTE	fsi_flag;		/* FSINFO flags (b7:disabled, b0:dirty) */
@@ -85,6 +86,7 @@ typedef struct {
 	WORD	n_rootdir;		/* Number of root directory entries (FAT12/16) */
 #if _MAX_SS != _MIN_SS
 	WORD	ssize;			/* Bytes per sector (512, 1024, 2048 or 4096) */
+	BYTE	sshift;			/* Bytes per sector in log2 (9..12) */
 #endif
 #if _FS_REENTRANT
 	_SYNC_t	sobj;			/* Identifier of sync object */
@@ -92,9 +94,25 @@ typedef struct {
 #if !_FS_READONLY
 	DWORD	last_clust;		/* Last allocated cluster */
 	DWORD	free_clust;		/* Number of free clusters */
+#if _FS_FREEMAP
+	BYTE	fmshift;		/* Clusters per bit of the free cluster map in log2 (0:map disabled) */
+	BYTE	fmap[_FS_FREEMAP];	/* Free cluster map (bit=0:no free cluster in the part of the FAT) */
+#endif
+#if _FS_LAZYFAT
+	BYTE	jnum;			/* Number of dirty FAT regions in the journal */
+	BYTE	jsyncs;			/* Number of syncs since the last checkpoint */
+	DWORD	jsect[_FS_LAZYFAT];	/* Dirty FAT regions: first sector (offset in the FAT) */
+	DWORD	jend[_FS_LAZYFAT];	/* Dirty FAT regions: next sector after the region */
+#endif
 #endif
 #if _FS_RPATH
 	DWORD	cdir;			/* Current directory start cluster (0:root) */
+#endif
+#if _FS_QUICKMOUNT
+	BYTE	mtype;			/* FAT sub-type of the last mount for quick remount (0:None) */
+#endif
+#if _FS_QUICKMOUNT || (!_FS_READONLY && _FS_LAZYFAT)
+	DWORD	vsn;			/* Volume serial number of the last mount */
 #endif
 	DWORD	n_fatent;		/* Number of FAT entries (= number of clusters + 2) */
 	DWORD	fsize;			/* Sectors per FAT */
@@ -104,6 +122,12 @@ typedef struct {
 	DWORD	database;		/* Data start sector */
 	DWORD	winsect;		/* Current sector appearing in the win[] */
 	BYTE	win[_MAX_SS];	/* Disk access window for Directory, FAT (and file data at tiny cfg) */
+#if _FS_WINDOWS >= 2
+	DWORD	pwsect[_FS_WINDOWS - 1];	/* Sectors held in the parking buffers (0xFFFFFFFF:blank) */
+	BYTE	pwflag[_FS_WINDOWS - 1];	/* Parking buffer flags (b0:dirty) */
+	BYTE	pwage[_FS_WINDOWS - 1];		/* Parking buffer LRU order (0:most recently used) */
+	BYTE	pwin[_FS_WINDOWS - 1][_MAX_SS];	/* Parking buffers for the sectors moved out of win[] */
+#endif
 } FATFS;
 
 
@@ -137,6 +161,19 @@ typedef struct {
 
 
 
+/* Directory entry location structure (FILOC) */
+
+#if _USE_OPENLOC
+typedef struct {
+	DWORD	sect;			/* Sector containing the directory entry (0:Not known) */
+	WORD	index;			/* Index of the entry in the sector */
+	BYTE	name[11];		/* SFN of the entry {file[8],ext[3]} */
+	DWORD	sclust;			/* File data start cluster */
+} FILOC;
+#endif
+
+
+
 /* Directory object structure (DIR) */
 
 typedef struct {
@@ -206,6 +243,9 @@ typedef enum {
 /* FatFs module application interface                           */
 
 FRESULT f_open (FIL* fp, const TCHAR* path, BYTE mode);				/* Open or create a file */
+#if _USE_OPENLOC
+FRESULT f_openloc (FIL* fp, const TCHAR* path, BYTE mode, FILOC* loc);	/* Open a file at the remembered directory entry */
+#endif
 FRESULT f_close (FIL* fp);											/* Close an open file object */
 FRESULT f_read (FIL* fp, void* buff, UINT btr, UINT* br);			/* Read data from a file */
 FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data to a file */
@@ -17,6 +17,25 @@
 /  from the file object (FIL). */
 
 
+#define	_FS_WINDOWS		2	/* 1 to 4 */
+/* The _FS_WINDOWS option defines number of sector buffers in the file system
+/  object. FatFs always works on the first one (win[]) and the others keep the
+/  sectors recently moved out of it, with write-back and LRU replacement. This
+/  stops FAT, directory and file data sectors (at tiny cfg) evicting each other.
+/  Each additional buffer consumes _MAX_SS bytes of the file system object.
+/  On the 2KB ATmega32 the second buffer fits only because the logger keeps
+/  its records packed in RAM. A third one does not leave enough stack.
+/
+/   1: Single sector window.
+/   2-4: Sector window and 1 to 3 parking buffers. */
+
+
+#define	_FS_FATWIN		0	/* 0:Disable or 1:Enable */
+/* When _FS_FATWIN is set to 1, the first parking buffer is dedicated to the FAT
+/  sectors, so directory and file data traffic never pushes the FAT sector out
+/  of the cache. This option requires _FS_WINDOWS >= 3. */
+
+
 #define _FS_READONLY	0	/* 0:Read/Write or 1:Read only */
 /* Setting _FS_READONLY to 1 defines read only configuration. This removes
 /  writing functions, f_write(), f_sync(), f_unlink(), f_mkdir(), f_chmod(),
@@ -33,6 +52,41 @@
 /   3: f_lseek() function is removed in addition to 2. */
 
 
+#define	_FS_FREEMAP		8	/* 0:Disable or 1-64:Size of the map in bytes */
+/* When _FS_FREEMAP is not zero, the file system object holds a map of the FAT
+/  with one bit per part of the FAT table. A cleared bit means the part has no
+/  free cluster, so cluster allocation skips it without reading its sectors.
+/  The map is built lazily during cluster scan and updated when a cluster is
+/  freed. It is not used on FAT12 volumes and at read-only cfg. */
+
+
+#define	_FS_QUICKMOUNT	1	/* 0:Disable or 1:Enable */
+/* When _FS_QUICKMOUNT is 1, the file system object keeps the geometry of the
+/  last mounted volume. The next mount of the object reads the boot sector of
+/  the volume only and, if its BPB and serial number match, the volume is
+/  mounted without partition search, BPB analysis and FSINFO read. The cluster
+/  allocation information and the free cluster map are kept as well. */
+
+
+#define	_FS_ONLYFAT		0	/* 0:Any FAT sub-type, 16:FAT16 only or 32:FAT32 only */
+/* When _FS_ONLYFAT is 16 or 32, the module is built for one FAT sub-type and
+/  the code for the other ones is removed by the compiler. A volume of another
+/  sub-type is rejected with FR_NO_FILESYSTEM. SD cards up to 2GB are usually
+/  formatted as FAT16 and SDHC cards as FAT32. */
+
+
+#define	_FS_LAZYFAT		4	/* 0:Disable or 1-8:Number of dirty FAT regions in the journal */
+#define	_FS_CHECKPOINT	8	/* 0:Only on clean unmount or 1-255:Syncs between checkpoints */
+/* When _FS_LAZYFAT is not zero, a FAT sector written back to the volume is
+/  written to the first FAT only and its offset is recorded in a journal of
+/  dirty FAT regions held in the file system object. The FAT copies and the
+/  FSINFO sector are updated at a checkpoint, which takes place on every
+/  _FS_CHECKPOINT-th sync and on clean unmount (f_mount(0, path, 1)). The
+/  first FAT is always written first and it is authoritative if the volume
+/  is not unmounted cleanly. The journal is kept across f_mount(0, path, 0)
+/  and remount of the same volume. It is not used at read-only cfg. */
+
+
 #define	_USE_STRFUNC	0	/* 0:Disable or 1-2:Enable */
 /* To enable string functions, set _USE_STRFUNC to 1 or 2. */
 
@@ -41,10 +95,17 @@
 /* To enable f_mkfs() function, set _USE_MKFS to 1 and set _FS_READONLY to 0 */
 
 
-#define	_USE_FASTSEEK	0	/* 0:Disable or 1:Enable */
+#define	_USE_FASTSEEK	1	/* 0:Disable or 1:Enable */
 /* To enable fast seek feature, set _USE_FASTSEEK to 1. */
 
 
+#define	_USE_OPENLOC	1	/* 0:Disable or 1:Enable */
+/* To enable f_openloc() function, set _USE_OPENLOC to 1. It opens a file at
+/  the directory entry location remembered by the previous call and falls back
+/  to the path lookup when the entry does not match. It is not available at
+/  read-only cfg and with _FS_LOCK. */
+
+
 #define _USE_LABEL		0	/* 0:Disable or 1:Enable */
 /* To enable volume label functions, set _USE_LAVEL to 1 */
 
@@ -0,0 +1,274 @@
+/*
+ *  led.c
+ *
+ *  Utworzono: 2015-01-17 12:05:48
+ *  Autor: Adam Grser
+ */
+
+#include "led.h"
+
+
+
+/// Liczba przerwa licznika Timer/Counter2 w cigu wier sekundy.
+#define LED_TICKS_PER_QUARTER (LED_TICK_HZ / 4)
+
+/**
+ * Sekwencja migni diodami.
+ * @field mask Maska diod
+ * @field repeats Liczba migni
+ * @field on Czas wiecenia (w przerwaniach licznika)
+ * @field off Czas niewiecenia (w przerwaniach licznika)
+ */
+typedef struct {
+	uint8_t mask;
+	uint8_t repeats;
+	uint8_t on;
+	uint8_t off;
+} led_pattern;
+
+volatile uint8_t second_tick = 0;
+
+/// Kolejka sekwencji migni (bufor cykliczny), pierwszy element to sekwencja w trakcie odtwarzania.
+static led_pattern led_queue[LED_QUEUE_SIZE];
+
+/// Indeks pierwszego elementu kolejki.
+static uint8_t led_head = 0;
+
+/// Liczba sekwencji w kolejce.
+static volatile uint8_t led_count = 0;
+
+/// Numer etapu biecej sekwencji (etapy parzyste - diody zgaszone, nieparzyste - zapalone).
+static uint8_t led_step = 0;
+
+/// Liczba przerwa licznika pozostaa do koca biecego etapu sekwencji.
+static uint8_t led_left = 0;
+
+/// Stan diod wynikajcy z sygnalizacji stanu urzdzenia (bez sekwencji migni).
+static uint8_t led_base = LED_GREEN;
+
+/// Licznik przerwa w biecej wiartce sekundy.
+static uint8_t led_ticks = 0;
+
+/// Numer biecej wiartki sekundy (0 - 3).
+static uint8_t led_quarter = 0;
+
+/// Czas trwania migni w procentach czasw podawanych w funkcji LedPattern.
+static uint8_t led_speed = 100;
+
+/// Determinuje czy Timer/Counter2 zgasza przerwania z czstotliwoci LED_IDLE_HZ (diody nie migaj).
+static uint8_t led_idle = 0;
+
+/// Maska diod zapalonych na czas zapisu na kart SD (patrz @see LedBusy), niezalenie od sygnalizacji stanu urzdzenia.
+static uint8_t led_busy = 0;
+
+///@name Biezaca_sekwencja
+//@{
+	/// Maska i stan diod sterowanych przez biec sekwencj migni
+	static uint8_t led_mask = 0, led_state = 0;
+//@}
+
+
+
+/**
+ * Przeliczenie czasu w milisekundach na liczb przerwa licznika Timer/Counter2.
+ * @param ms Czas w milisekundach
+ * @return Liczba przerwa (co najmniej 1, najwyej 255), z uwzgldnieniem led_speed
+ */
+static uint8_t LedTicks(uint16_t ms)
+{
+	uint16_t ticks = ((uint32_t)ms * led_speed / 100 + 500 / LED_TICK_HZ) / (1000 / LED_TICK_HZ);
+
+	return ticks > 255 ? 255 : (ticks ? ticks : 1);
+}
+
+
+
+/// Wyznaczenie stanu diod sygnalizujcego stan urzdzenia, na pocztku kadej wiartki sekundy.
+static void LedStatus(void)
+{
+	if(!led_quarter)
+	{
+		/* flaga VL ustawiona => dioda zielona miga (ok. 0,5 Hz)
+		 * w przeciwnym razie => dioda zielona wieci si cigle */
+		if(device_flags.vl)
+			led_base ^= LED_GREEN;
+		else
+			led_base |= LED_GREEN;
+	}
+
+	/* no_sd_card									0,5 Hz (zmiana stanu co 1 s)
+	 * buffer_full (bd komunikacji z kart)		1 Hz   (zmiana stanu co 500 ms)
+	 * no_sd_card && buffer_full					2 Hz   (zmiana stanu co 250 ms)
+	 * w przeciwnym razie dioda czerwona jest zgaszona */
+	if(device_flags.no_sd_card && device_flags.buffer_full)
+		led_base ^= LED_RED;
+	else if(device_flags.buffer_full)
+	{
+		if(!(led_quarter & 1))
+			led_base ^= LED_RED;
+	}
+	else if(device_flags.no_sd_card)
+	{
+		if(!led_quarter)
+			led_base ^= LED_RED;
+	}
+	else
+		led_base &= ~LED_RED;
+}
+
+
+
+/// Ustawienie diod: sekwencja migni ma pierwszestwo przed sygnalizacj zapisu na kart SD, a ta - przed sygnalizacj stanu urzdzenia.
+static void LedOutput(void)
+{
+	PORTD = (PORTD & ~LED_BOTH) | ((led_base | led_busy) & ~led_mask) | led_state;
+}
+
+
+
+/**
+ * Zmiana czstotliwoci przerwa licznika Timer/Counter2.<br>
+ * Gdy diody nie migaj, przerwania potrzebne s tylko do odmierzania sekund, wic procesor wybudzany jest jedynie LED_IDLE_HZ razy na sekund.
+ * @param idle 1 - czstotliwo LED_IDLE_HZ, 0 - czstotliwo LED_TICK_HZ
+ */
+static void LedRate(uint8_t idle)
+{
+	if(idle == led_idle)
+		return;
+
+	led_idle = idle;
+
+	OCR2 = idle ? LED_IDLE_OCR : LED_TICK_OCR;
+	TCCR2 = 1 << WGM21 | (idle ? LED_IDLE_CLOCK_SELECT : LED_TICK_CLOCK_SELECT);
+
+	/* licznik mg ju min now warto OCR2 - rozpoczcie odliczania od nowa */
+	TCNT2 = 0;
+}
+
+
+
+/**
+ * Obsuga przerwa z licznika Timer/Counter2 (LED_TICK_HZ razy na sekund, a gdy diody nie migaj - LED_IDLE_HZ razy na sekund).<br>
+ * Odtwarzanie sekwencji migni z kolejki, sygnalizacja stanu urzdzenia i odmierzanie sekund dla ptli gwnej programu.
+ * @param TIMER2_COMP_vect Wektor przerwania przy zrwnaniu licznika Timer/Counter2 z rejestrem OCR2.
+ */
+ISR(TIMER2_COMP_vect)
+{
+	led_pattern *pattern;
+
+	/* przerwanie o czstotliwoci LED_IDLE_HZ odpowiada LED_IDLE_STEP przerwaniom o czstotliwoci LED_TICK_HZ */
+	led_ticks += led_idle ? LED_IDLE_STEP : 1;
+
+	if(led_ticks >= LED_TICKS_PER_QUARTER)
+	{
+		led_ticks -= LED_TICKS_PER_QUARTER;
+		led_quarter = (led_quarter + 1) & 3;
+
+		if(!led_quarter)
+			second_tick = 1;
+
+		LedStatus();
+	}
+
+	led_mask = led_state = 0;
+
+	if(led_count)
+	{
+		pattern = &led_queue[led_head];
+
+		/* koniec biecego etapu - przejcie do nastpnego (zgaszenie i zapalenie diod na przemian) */
+		if(!led_left)
+		{
+			if(++led_step > 2 * pattern->repeats)
+			{
+				/* koniec sekwencji - przejcie do nastpnej w kolejce */
+				led_head = (led_head + 1) % LED_QUEUE_SIZE;
+				--led_count;
+				led_step = 0;
+				pattern = led_count ? &led_queue[led_head] : 0;
+			}
+
+			if(pattern)
+				led_left = led_step & 1 ? pattern->on : pattern->off;
+		}
+
+		if(pattern)
+		{
+			--led_left;
+			led_mask = pattern->mask;
+			led_state = led_step & 1 ? led_mask : 0;
+		}
+	}
+
+	/* diody poza biec sekwencj sygnalizuj zapis na kart SD lub stan urzdzenia */
+	LedOutput();
+
+	/* zielona dioda wieci si cigle, a czerwona jest zgaszona - do kolejnej sekwencji migni wystarczy odmierzanie sekund */
+	LedRate(!led_count && !device_flags.vl && !device_flags.no_sd_card && !device_flags.buffer_full);
+}
+
+
+
+void LedInit(void)
+{
+	/* Timer/Counter2 w trybie CTC z preskalerem LED_TICK_PRESCALER */
+	OCR2 = LED_TICK_OCR;
+	TCCR2 = 1 << WGM21 | LED_TICK_CLOCK_SELECT;
+	TIMSK |= 1 << OCIE2;
+}
+
+
+
+void LedPattern(uint8_t mask, uint8_t repeats, uint16_t on_ms, uint16_t off_ms)
+{
+	uint8_t sreg = SREG;
+	led_pattern *pattern;
+
+	cli();
+
+	if(led_count < LED_QUEUE_SIZE)
+	{
+		pattern = &led_queue[(led_head + led_count) % LED_QUEUE_SIZE];
+		pattern->mask = mask;
+		pattern->repeats = repeats;
+		pattern->on = LedTicks(on_ms);
+		pattern->off = LedTicks(off_ms);
+
+		/* pierwsza sekwencja w kolejce rozpoczyna si od zgaszenia diod */
+		if(!led_count)
+		{
+			led_step = 0;
+			led_left = pattern->off;
+		}
+
+		++led_count;
+
+		/* sekwencja odtwarzana jest z pen czstotliwoci przerwa */
+		LedRate(0);
+	}
+
+	SREG = sreg;
+}
+
+
+
+void LedBusy(uint8_t on)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+
+	led_busy = on ? LED_RED : 0;
+
+	/* przy czstotliwoci LED_IDLE_HZ kolejne przerwanie moe nastpi dopiero po wiartce sekundy - diody ustawiane s od razu */
+	LedOutput();
+
+	SREG = sreg;
+}
+
+
+
+void LedSpeed(uint8_t percent)
+{
+	led_speed = percent;
+}
@@ -0,0 +1,67 @@
+/*
+ *  led.h
+ *
+ *  Utworzono: 2015-01-17 12:05:48
+ *  Autor: Adam Grser
+ */
+
+#ifndef LED_H
+#define LED_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint-gcc.h>
+#include "utils.h"
+#include "timing.h"
+
+
+
+///@name Maski_diod
+//@{
+	/// Dioda LED1 PD7 zielona
+	#define LED_GREEN (1 << PD7)
+	/// Dioda LED2 PD6 czerwona
+	#define LED_RED (1 << PD6)
+	/// Obie diody
+	#define LED_BOTH (LED_GREEN | LED_RED)
+//@}
+
+/// Maksymalna liczba sekwencji migni oczekujcych w kolejce.
+#define LED_QUEUE_SIZE 4
+
+/// Flaga upywu kolejnej sekundy, ustawiana przez Timer/Counter2 i czyszczona w ptli gwnej programu.
+extern volatile uint8_t second_tick;
+
+
+
+/// Uruchomienie licznika Timer/Counter2, ktry steruje diodami i odmierza sekundy dla ptli gwnej programu (gdy diody nie migaj, przerwania zgaszane s rzadziej).
+void LedInit(void);
+
+/**
+ * Dodanie do kolejki sekwencji migni diodami (funkcja nie czeka na jej odtworzenie).<br>
+ * Na czas sekwencji wskazane diody s gaszone na 'off_ms' milisekund, po czym migaj wskazan ilo razy.
+ * Po odtworzeniu wszystkich sekwencji z kolejki diody wracaj do sygnalizacji stanu urzdzenia.
+ * Jeli kolejka jest pena, sekwencja jest pomijana.
+ * @param mask Maska diod (LED_GREEN, LED_RED lub LED_BOTH)
+ * @param repeats Liczba migni
+ * @param on_ms Czas w milisekundach, przez jaki diody maj si wieci (do 2550 ms, przed przeliczeniem przez @see LedSpeed)
+ * @param off_ms Czas w milisekundach, przez jaki diody maj si nie wieci (do 2550 ms)
+ */
+void LedPattern(uint8_t mask, uint8_t repeats, uint16_t on_ms, uint16_t off_ms);
+
+/**
+ * Sygnalizacja zapisu na kart SD cigym wieceniem czerwonej diody (przesaniajcym sygnalizacj stanu urzdzenia, ale nie sekwencje migni).<br>
+ * Diody sterowane s wycznie przez Timer/Counter2, wic zapis nie moe zmienia stanu portu bezporednio.
+ * @param on 1 - rozpoczcie zapisu, 0 - zakoczenie zapisu
+ */
+void LedBusy(uint8_t on);
+
+/**
+ * Zmiana czasu trwania migni (dotyczy sekwencji dodanych do kolejki po wywoaniu funkcji).
+ * @param percent Czas trwania w procentach czasw podawanych w funkcji @see LedPattern (100 - bez zmian)
+ */
+void LedSpeed(uint8_t percent);
+
+
+
+#endif /* LED_H */
@@ -6,113 +6,370 @@
  */
 
 #include "rtc.h"
+#include "twi.h"
+#include "timing.h"
 
 
 
-/* ustawienie czstotliwoci dla TWI:
-	   SCL frequency = CPU Clock frequency / (16 + 2(TWBR) * 4^TWPS)
-	   dla TWBR = 0 i TWPS = 00 (wartoci domylne) powysze rwnanie da dzielnik rwny 16
-	   przy wewntrznym zegarze Atmegi taktujcym z czst. 1 MHz, otrzymam dla TWI czst. 62,5 KHz
-	   TWBR - TWI Bit rate Register
-	   TWSR - TWI Status Register:
-	       TWSR1:0 -> TWPS1, TWPS0 - TWI PreScaler bits */
+/// Adres zegara RTC PCF8563P na magistrali I2C (w trybie zapisu).
+#define RTC_ADDRESS 0xA2
 
+///@name Rejestry_RTC
+//@{
+	/// Rejestr Control_status_2 (b4: TI_TP, b3: AF, b2: TF, b1: AIE, b0: TIE)
+	#define RTC_CONTROL_STATUS_2 0x01
+	/// Rejestr CLKOUT_control (b7: FE, b1:0: FD - czstotliwo sygnau CLKOUT)
+	#define RTC_CLKOUT_CONTROL 0x0D
+	/// Rejestr Timer_control (b7: TE, b1:0: TD - czstotliwo taktowania timera)
+	#define RTC_TIMER_CONTROL 0x0E
+//@}
 
+/// Determinuje czy od ostatniego przepenienia licznika Timer/Counter1 przechwycono zbocze sygnau CLKOUT.
+static volatile uint8_t rtc_second_seen = 0;
 
-void TwiStart(void)
+/// Determinuje czy sygna CLKOUT dociera do mikrokontrolera (czy rejestr ICR1 wskazuje pocztek biecej sekundy).
+static volatile uint8_t rtc_second_valid = 0;
+
+/// Numer biecej sekundy RTC (licznik zboczy sygnau CLKOUT, przepenia si co 256 s), uywany w znacznikach chwili zdarze.
+static volatile uint8_t rtc_second = 0;
+
+/// Numer sekundy RTC, ktrej dotyczy ostatni udany odczyt funkcj @see RtcGetTime (wany tylko, gdy rtc_read_valid = 1).
+static uint8_t rtc_read_second;
+
+/// Determinuje czy ostatni odczyt funkcj @see RtcGetTime si powid i czy wyznaczono w nim milisekundy.
+static uint8_t rtc_read_valid = 0;
+
+time rtc_time;
+
+volatile uint8_t rtc_time_valid = 0;
+
+/// Wartoci rejestrw od VL_seconds do Years (w kodzie BCD), odczytywane w tle.
+static uint8_t rtc_sync_regs[7];
+
+static void RtcSyncDone(twi_transfer *transfer);
+
+/// Transakcja odczytu daty i czasu w tle.
+static twi_transfer rtc_sync = { RTC_ADDRESS, 0x02, 1, 7, rtc_sync_regs, RtcSyncDone, TWI_OK };
+
+
+
+/**
+ * Konwersja zawartoci rejestrw od VL_seconds do Years z kodu BCD, z pominiciem nieistotnych bitw.
+ * @param buf Adres struktury, do ktrej zapisane maj zosta data i czas
+ * @param regs Wartoci kolejnych rejestrw RTC
+ */
+static void RtcDecode(time *buf, const uint8_t *regs)
 {
-	TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTA);
-	while(!(TWCR & (1 << TWINT)));
+	/* jeli najstarszy bit rejestru VL_seconds (flaga VL) ma warto 1, moliwa jest utrata dokadnoci pomiaru czasu,
+	 * naley wic ustawi odpowiedni flag globaln programu */
+	if(regs[0] & 128)
+		device_flags.vl = 1;
+	
+	/* dni tygodnia (regs[4]) nie s potrzebne - odczytujemy z koniecznoci zachowania kolejnoci */
+	buf->seconds = ((((regs[0] & 0x70) >> 4) * 10) + (regs[0] & 0x0F));
+	buf->minutes = ((((regs[1] & 0x70) >> 4) * 10) + (regs[1] & 0x0F));
+	buf->hours = ((((regs[2] & 0x30) >> 4) * 10) + (regs[2] & 0x0F));
+	buf->days = ((((regs[3] & 0x30) >> 4) * 10) + (regs[3] & 0x0F));
+	buf->months = ((((regs[5] & 0x10) >> 4) * 10) + (regs[5] & 0x0F));
+	buf->years = ((((regs[6] & 0xF0) >> 4) * 10) + (regs[6] & 0x0F));
+	buf->milliseconds = 0;
 }
 
 
 
-void TwiStop(void)
+/**
+ * Zakoczenie odczytu daty i czasu w tle (wywoywana przez modu TWI).
+ * @param transfer Zakoczona transakcja
+ */
+static void RtcSyncDone(twi_transfer *transfer)
 {
-	TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
-	while(!(TWCR & (1 << TWSTO)));
+	rtc_time_valid = transfer->status == TWI_OK;
+	
+	if(rtc_time_valid)
+		RtcDecode(&rtc_time, rtc_sync_regs);
 }
 
 
 
-void TwiWrite(uint8_t data)
+/**
+ * Obsuga przerwa z ukadu przechwytywania licznika Timer/Counter1.<br>
+ * Zbocze sygnau CLKOUT (pocztek sekundy RTC) zostao zapamitane w rejestrze ICR1.
+ * @param TIMER1_CAPT_vect Wektor przerwania przechwytywania licznika Timer/Counter1.
+ */
+ISR(TIMER1_CAPT_vect)
 {
-	TWDR = data;
+	rtc_second_seen = rtc_second_valid = 1;
+	++rtc_second;
+}
+
 
-	TWCR = (1 << TWINT) | (1 << TWEN);
-	while(!(TWCR & (1 << TWINT)));
+
+/**
+ * Obsuga przerwa z 16-bitowego licznika Timer/Counter1.<br>
+ * Brak zbocza sygnau CLKOUT pomidzy kolejnymi przepenieniami (ok. 4 s) oznacza, e milisekund nie da si wyznaczy.
+ * @param TIMER1_OVF_vect Wektor przerwania przy przepenieniu 16-bitowego licznika Timer/Counter1.
+ */
+ISR(TIMER1_OVF_vect)
+{
+	if(!rtc_second_seen)
+		rtc_second_valid = 0;
+	
+	rtc_second_seen = 0;
 }
 
 
 
-uint8_t TwiRead(uint8_t ack)
+/**
+ * Odczyt stanu licznika Timer/Counter1, rejestru przechwytywania i numeru sekundy RTC bez przerw (przechwycenie pomidzy nimi wymusza ponowny odczyt).<br>
+ * Jeli zbocze sygnau CLKOUT zostao przechwycone, ale przerwanie TIMER1_CAPT nie zostao jeszcze obsuone, numer sekundy jest odpowiednio zwikszany.
+ * Wywoywana przy wyczonych przerwaniach.
+ * @param ticks Zmienna, do ktrej zapisany zostanie stan licznika
+ * @param second Zmienna, do ktrej zapisany zostanie numer sekundy RTC, ktrej pocztek wskazuje rejestr ICR1
+ * @return Stan rejestru ICR1 (pocztek sekundy)
+ */
+static uint16_t RtcCounter(uint16_t *ticks, uint8_t *second)
 {
-	TWCR = ack ? (((1 << TWINT) | (1 << TWEN) | (1 << TWEA))) : (((1 << TWINT) | (1 << TWEN)));
+	uint16_t start;
+	uint8_t pending;
+	
+	do
+	{
+		pending = TIFR & (1 << ICF1);
+		start = ICR1;
+		*ticks = TCNT1;
+	} while(start != ICR1 || pending != (TIFR & (1 << ICF1)));
 	
-	while(!(TWCR & (1 << TWINT)));
+	*second = pending ? rtc_second + 1 : rtc_second;
 	
-	return TWDR;
+	return start;
+}
+
+
+
+/**
+ * Cofnicie daty i czasu o wskazan liczb sekund (z uwzgldnieniem zmiany minuty, godziny, dnia, miesica i roku).
+ * @param t Data i czas
+ * @param seconds Liczba sekund
+ */
+static void RtcSubtract(time *t, uint8_t seconds)
+{
+	while(seconds--)
+	{
+		if(t->seconds)
+		{
+			--t->seconds;
+			continue;
+		}
+		
+		t->seconds = 59;
+		
+		if(t->minutes)
+		{
+			--t->minutes;
+			continue;
+		}
+		
+		t->minutes = 59;
+		
+		if(t->hours)
+		{
+			--t->hours;
+			continue;
+		}
+		
+		t->hours = 23;
+		
+		if(--t->days)
+			continue;
+		
+		/* ostatni dzie poprzedniego miesica (rok przestpny okrelany jest tak samo, jak przy ustawianiu daty w RTC) */
+		if(--t->months == 0)
+		{
+			t->months = 12;
+			t->years = (t->years + 99) % 100;
+		}
+		
+		t->days = t->months == 2 ? (t->years % 4 ? 28 : 29) : (t->months == 4 || t->months == 6 || t->months == 9 || t->months == 11) ? 30 : 31;
+	}
+}
+
+
+
+void RtcInitClock(void)
+{
+	/* CLKOUT_control: FE = 1, FD = 11 (1 Hz) */
+	uint8_t clkout = 0x83;
+	
+	TwiWriteRegs(RTC_ADDRESS, RTC_CLKOUT_CONTROL, &clkout, 1);
+	
+	/* komparator analogowy: na wejciu dodatnim napicie odniesienia (bandgap), na ujemnym CLKOUT (PB3/AIN1),
+	 * wyjcie komparatora steruje ukadem przechwytywania licznika Timer/Counter1 */
+	ACSR = 1 << ACBG | 1 << ACIC;
+	
+	/* Timer/Counter1 w trybie normalnym, przechwytywanie przy zboczu narastajcym wyjcia komparatora (zbocze opadajce CLKOUT) */
+	TCCR1A = 0;
+	TCCR1B = 1 << ICES1 | SUBSECOND_CLOCK_SELECT;
+	
+	/* wczenie przerwa przechwytywania i przepenienia licznika */
+	TIMSK |= 1 << TICIE1 | 1 << TOIE1;
 }
 
 
 
 void RtcGetTime (time *buf)
 {
-	/* nawizanie poczenia z RTC */
-	TwiStart();
-	TwiWrite(0xA2);				/* adres slave-receiver */
-	TwiWrite(0x02);				/* wystawienie adresu rejestru VL_seconds */
-	TwiStop();
-	
-	/* czytanie odpowiedzi z RTC */
-	TwiStart();
-	TwiWrite(0xA3);				/* adres slave-transmitter */
-	buf->seconds = TwiRead(1);	/* aktywacja bitu potwierdzenia oznacza ch odczytu kolejnego bajta danych */
-	buf->minutes = TwiRead(1);
-	buf->hours = TwiRead(1);
-	buf->days = TwiRead(1);
-	TwiRead(1);					/* dni tygodnia nie s potrzebne - odczytujemy z koniecznoci zachowania kolejnoci */
-	buf->months = TwiRead(1);
-	buf->years = TwiRead(0);
-	TwiStop();
+	/* wartoci rejestrw od VL_seconds do Years w kodzie BCD */
+	uint8_t regs[7];
+	/* stan licznika w chwili odczytu i w chwili rozpoczcia biecej sekundy RTC */
+	uint16_t ticks, start;
+	/* liczba prb odczytu */
+	uint8_t tries = 2;
+	/* numer biecej sekundy RTC */
+	uint8_t second;
+	uint8_t sreg;
 	
-	/* jeli najstarszy bit rejestru VL_seconds (flaga VL) ma warto 1, moliwa jest utrata dokadnoci pomiaru czasu,
-	 * naley wic ustawi odpowiedni flag globaln programu */
-	if(buf->seconds & 128)
-		device_flags.vl = 1;
+	rtc_read_valid = 0;
 	
-	/* konwersja danych z kodu BCD, pominicie nieistotnych bitw */
-	buf->seconds = ((((buf->seconds & 0x70) >> 4) * 10) + (buf->seconds & 0x0F));
-	buf->minutes = ((((buf->minutes & 0x70) >> 4) * 10) + (buf->minutes & 0x0F));
-	buf->hours = ((((buf->hours & 0x30) >> 4) * 10) + (buf->hours & 0x0F));
-	buf->days = ((((buf->days & 0x30) >> 4) * 10) + (buf->days & 0x0F));
-	buf->months = ((((buf->months & 0x10) >> 4) * 10) + (buf->months & 0x0F));
-	buf->years = ((((buf->years & 0xF0) >> 4) * 10) + (buf->years & 0x0F));
+	do
+	{
+		/* odczyt licznika i rejestru przechwytywania bez przerw */
+		sreg = SREG;
+		cli();
+		
+		start = RtcCounter(&ticks, &second);
+		
+		SREG = sreg;
+		
+		/* odczyt rejestrw, poczwszy od VL_seconds */
+		if(TwiReadRegs(RTC_ADDRESS, 0x02, regs, 7) != TWI_OK)
+		{
+			/* brak odpowiedzi RTC - data i czas mog by niedokadne */
+			device_flags.vl = 1;
+			
+			return;
+		}
+		
+		/* jeli w trakcie odczytu rozpocza si nowa sekunda, nie wiadomo, ktrej sekundy dotycz odczytane rejestry - odczyt jest powtarzany
+		 * (zdarza si to rzadko, tylko gdy odczyt wypadnie na granicy sekund) */
+	} while(start != ICR1 && --tries);
+	
+	RtcDecode(buf, regs);
+	
+	/* milisekundy od pocztku biecej sekundy (jeli licznik zosta przestawiony w trakcie odczytu lub brak sygnau CLKOUT - 0) */
+	ticks -= start;
+	
+	if(rtc_second_valid && tries && ticks < SUBSECOND_TICKS)
+	{
+		buf->milliseconds = (uint32_t)ticks * 1000 / SUBSECOND_TICKS;
+		
+		/* odczytane rejestry dotycz sekundy, ktrej pocztek wskazuje ICR1 */
+		rtc_read_second = second;
+		rtc_read_valid = 1;
+	}
+	
+	/* odczytana data i czas s rwnie najwiesz wartoci dla odczytw w tle */
+	rtc_time = *buf;
+	rtc_time.milliseconds = 0;
+	rtc_time_valid = 1;
+}
+
+
+
+void RtcStamp(rtc_stamp *stamp)
+{
+	uint16_t start = RtcCounter(&stamp->ticks, &stamp->second);
+	
+	stamp->ticks -= start;
+	
+	/* brak sygnau CLKOUT - chwili zdarzenia nie da si odtworzy */
+	if(!rtc_second_valid)
+		stamp->ticks = SUBSECOND_TICKS;
+}
+
+
+
+void RtcStampTime(time *buf, const rtc_stamp *stamp)
+{
+	/* liczba sekund, ktre upyny od zdarzenia */
+	uint8_t elapsed;
+	
+	RtcGetTime(buf);
+	
+	/* jeli znacznik lub odczyt nie pozwalaj odtworzy chwili zdarzenia, pozostaje data i czas odczytu */
+	if(!rtc_read_valid || stamp->ticks >= SUBSECOND_TICKS)
+		return;
+	
+	elapsed = rtc_read_second - stamp->second;
+	
+	RtcSubtract(buf, elapsed);
+	buf->milliseconds = (uint32_t)stamp->ticks * 1000 / SUBSECOND_TICKS;
 }
 
 
 
 void RtcSetTime (uint8_t *data)
 {
-	/* przekonwertowanie danych do kodu BCD */
-	time temp;
-	temp.seconds = ((data[VL_seconds] / 10) << 4) | (data[VL_seconds] % 10); /* 0 na najstarszym bicie -> wyczyszczenie bitu VL */
-	temp.minutes = ((data[Minutes] / 10) << 4) | (data[Minutes] % 10);
-	temp.hours = ((data[Hours] / 10) << 4) | (data[Hours] % 10);
-	temp.days = ((data[Days] / 10) << 4) | (data[Days] % 10);
-	temp.months = ((data[Century_months] / 10) << 4) | (data[Century_months] % 10);
-	temp.years = ((data[Years] / 10) << 4) | (data[Years] % 10);
-		
-	/* przesanie danych do RTC */
-	TwiStart();
-	TwiWrite(0xA2);			/* adres slave-receiver */
-	TwiWrite(0x02);			/* wystawienie adresu rejestru VL_seconds */
-	TwiWrite(temp.seconds);
-	TwiWrite(temp.minutes);
-	TwiWrite(temp.hours);
-	TwiWrite(temp.days);
-	TwiWrite(0);			/* dni tygodnia nie s potrzebne - ustawiamy z koniecznoci zachowania kolejnoci */
-	TwiWrite(temp.months);  /* (bdzie szybciej ni przerwanie transmisji i rozpoczcie nowej, z adresem rejestru Century_months) */
-	TwiWrite(temp.years);
-	TwiStop();
+	/* wartoci kolejnych rejestrw od VL_seconds do Years, przekonwertowane do kodu BCD */
+	uint8_t regs[7];
+	
+	regs[0] = ((data[VL_seconds] / 10) << 4) | (data[VL_seconds] % 10); /* 0 na najstarszym bicie -> wyczyszczenie bitu VL */
+	regs[1] = ((data[Minutes] / 10) << 4) | (data[Minutes] % 10);
+	regs[2] = ((data[Hours] / 10) << 4) | (data[Hours] % 10);
+	regs[3] = ((data[Days] / 10) << 4) | (data[Days] % 10);
+	regs[4] = 0;			/* dni tygodnia nie s potrzebne - ustawiamy z koniecznoci zachowania kolejnoci */
+	regs[5] = ((data[Century_months] / 10) << 4) | (data[Century_months] % 10);
+	regs[6] = ((data[Years] / 10) << 4) | (data[Years] % 10);
+	
+	/* przesanie danych do RTC w jednej transakcji (czas oczekiwania na jej zakoczenie jest ograniczony) */
+	TwiWriteRegs(RTC_ADDRESS, 0x02, regs, 7);
+	
+	/* dane w rtc_time s nieaktualne */
+	rtc_time_valid = 0;
+}
+
+
+
+void RtcStartSync(void)
+{
+	if(rtc_sync.status != TWI_BUSY)
+		TwiSubmit(&rtc_sync);
+}
+
+
+
+uint8_t RtcStartTimer(uint8_t seconds)
+{
+	/* Timer_control: TE = 1, TD = 10 (1 Hz), Timer: liczba sekund do odliczenia */
+	uint8_t regs[2] = { 0x82, seconds };
+	/* Control_status_2: TIE = 1 (przerwanie timera), TI_TP = 0 (stan niski na INT a do wyczyszczenia TF), TF = 0 */
+	uint8_t control = 0x01;
+	
+	/* zapis rejestru Timer rozpoczyna odliczanie od nowa */
+	if(TwiWriteRegs(RTC_ADDRESS, RTC_TIMER_CONTROL, regs, 2) != TWI_OK)
+		return TWI_ERROR;
+	
+	return TwiWriteRegs(RTC_ADDRESS, RTC_CONTROL_STATUS_2, &control, 1);
+}
+
+
+
+uint8_t RtcClearTimer(void)
+{
+	/* TIE = 1, TF = 0 (flagi RTC czyszczone s zapisem zera) */
+	uint8_t control = 0x01;
+	
+	return TwiWriteRegs(RTC_ADDRESS, RTC_CONTROL_STATUS_2, &control, 1);
+}
+
+
+
+void RtcStopTimer(void)
+{
+	/* Control_status_2: wyczenie przerwa i wyczyszczenie flag */
+	uint8_t control = 0;
+	/* Timer_control: TE = 0, TD = 11 (1/60 Hz - najmniejszy pobr prdu) */
+	uint8_t timer = 0x03;
+	
+	TwiWriteRegs(RTC_ADDRESS, RTC_CONTROL_STATUS_2, &control, 1);
+	TwiWriteRegs(RTC_ADDRESS, RTC_TIMER_CONTROL, &timer, 1);
 }
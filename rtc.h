@@ -23,6 +23,7 @@
  * @field days dni
  * @field months miesice
  * @field years lata
+ * @field milliseconds milisekundy (tylko w danych zwracanych przez funkcj @see RtcGetTime, w pozostaych przypadkach 0)
  */
 typedef struct {
 	uint8_t seconds;
@@ -31,41 +32,91 @@ typedef struct {
 	uint8_t days;
 	uint8_t months;
 	uint8_t years;
+	uint16_t milliseconds;
 } time;
 
+/**
+ * Znacznik chwili zdarzenia, pobierany w procedurze obsugi przerwania bez komunikacji z RTC (patrz @see RtcStamp).
+ * @field second Numer sekundy RTC (licznik zboczy sygnau CLKOUT)
+ * @field ticks Liczba taktw licznika Timer/Counter1 od pocztku tej sekundy (SUBSECOND_TICKS, jeli sygna CLKOUT nie dociera do mikrokontrolera)
+ */
+typedef struct {
+	uint8_t second;
+	uint16_t ticks;
+} rtc_stamp;
 
 
-/// Sygnalizowanie rozpoczcia transmisji danych na magistral I2C za pomoc TWI
-void TwiStart(void);
 
-/// Sygnalizowanie zakoczenia transmisji danych na magistral I2C za pomoc TWI
-void TwiStop(void);
+/// Data i czas odczytane z RTC w tle (funkcja @see RtcStartSync) lub podczas ostatniego wywoania funkcji @see RtcGetTime
+extern time rtc_time;
+
+/// Determinuje czy zawarto rtc_time pochodzi z udanego odczytu RTC.
+extern volatile uint8_t rtc_time_valid;
+
 
-/**
- * Przesanie 1 bajta danych na magistral I2C za pomoc TWI
- * @param data Dane do przesania
- */
-void TwiWrite(uint8_t data);
 
 /**
- * Odczytanie 1 bajta danych z magistrali I2C za pomoc TWI
- * @param ack 1 = wczenie bitu potwierdzenia (po tej operacji nastpi odczyt kolejnego bajta danych), 0 = wyczenie bitu potwierdzenia (koniec czytania danych)
- * @return Zawarto rejestru danych TWDR (dane odczytane z magistrali)
+ * Przygotowanie pomiaru czci uamkowych sekundy: wczenie wyjcia CLKOUT zegara RTC (1 Hz, podczone do PB3/AIN1),
+ * komparatora analogowego przekazujcego jego zbocza do ukadu przechwytywania (input capture) licznika Timer/Counter1
+ * oraz samego licznika, zliczajcego w sposb cigy.
  */
-uint8_t TwiRead(uint8_t ack);
+void RtcInitClock(void);
 
 /**
- * Pobranie biecej daty i czasu z zegara RTC PCF8563P
+ * Pobranie biecej daty i czasu z zegara RTC PCF8563P (czas oczekiwania na odpowied RTC jest ograniczony).<br>
+ * Milisekundy wyznaczane s ze stanu licznika Timer/Counter1 wzgldem ostatniego zbocza sygnau CLKOUT, czyli pocztku biecej sekundy RTC
+ * (0, jeli sygna CLKOUT nie dociera do mikrokontrolera).<br>
+ * Jeli odczyt si nie powiedzie, zawarto bufora nie zmienia si, a flaga VL zostaje ustawiona.
  * @param buf Adres struktury, do ktrej zapisane maj zosta data i czas pobrane z RTC
  */
 void RtcGetTime (time *buf);
 
+/**
+ * Pobranie znacznika biecej chwili (numeru sekundy RTC i stanu licznika Timer/Counter1), bez komunikacji z RTC.<br>
+ * Wywoywana przy wyczonych przerwaniach, np. w procedurze obsugi przerwania, ktre wykryo zdarzenie.
+ * @param stamp Struktura, do ktrej zapisany zostanie znacznik
+ */
+void RtcStamp(rtc_stamp *stamp);
+
+/**
+ * Wyznaczenie daty i czasu (z milisekundami) chwili opisanej znacznikiem pobranym funkcj @see RtcStamp.<br>
+ * Bieca data i czas pobierane s z RTC (patrz @see RtcGetTime) i cofane o liczb sekund, ktre upyny od pobrania znacznika (najwyej 255 s).
+ * Jeli sygna CLKOUT nie dociera do mikrokontrolera, wynikiem jest data i czas odczytu.
+ * @param buf Adres struktury, do ktrej zapisane maj zosta data i czas
+ * @param stamp Znacznik chwili zdarzenia
+ */
+void RtcStampTime(time *buf, const rtc_stamp *stamp);
+
 /**
  * Wysanie do zegara RTC PCF8563P nowych ustawie daty i czasu
  * @param data Nowe ustawienia daty i czasu dla RTC
  */
 void RtcSetTime (uint8_t *data);
 
+/**
+ * Rozpoczcie odczytu daty i czasu z RTC w tle (jeli poprzedni odczyt si zakoczy).<br>
+ * Po zakoczeniu odczytu aktualizowane s zmienne rtc_time i rtc_time_valid oraz flaga VL.
+ */
+void RtcStartSync(void);
+
+/**
+ * Uruchomienie (lub ponowne rozpoczcie odliczania) timera odliczajcego RTC, taktowanego czstotliwoci 1 Hz.<br>
+ * Po kadym odliczeniu 'seconds' sekund RTC ustawia flag TF i wystawia stan niski na wyjciu INT (a do wyczyszczenia flagi),
+ * po czym odlicza kolejny okres.
+ * @param seconds Okres timera w sekundach (od 1 do 255)
+ * @return Stan transakcji TWI (TWI_OK jeli RTC przyj nowe ustawienia)
+ */
+uint8_t RtcStartTimer(uint8_t seconds);
+
+/**
+ * Wyczyszczenie flagi TF w RTC, zwalniajce wyjcie INT (timer odlicza dalej).
+ * @return Stan transakcji TWI (TWI_OK jeli flaga zostaa wyczyszczona)
+ */
+uint8_t RtcClearTimer(void);
+
+/// Zatrzymanie timera odliczajcego RTC i wyczenie jego przerwania.
+void RtcStopTimer(void);
+
 
 
 #endif /* RTC_H */
@@ -22,6 +22,7 @@
 /*-------------------------------------------------------------------------*/
 
 #include <avr/io.h>			/* Include device specific declareation file here */
+#include "timing.h"			/* F_CPU and SPI clock dividers */
 
 
 #define	CS_H()		PORTB |= 0x10	/* Set MMC CS "high" */
@@ -338,8 +339,8 @@ DSTATUS disk_initialize (
 	PORTB |= (1 << PB5) | (1 << PB4);				/* Initialize SCK, MOSI and SS as output */
 	PORTB &= 127;
 	DDRB = (1 << DDB7) | (1 << DDB5) | (1 << DDB4);
-	SPCR = (1 << SPE) | (1 << MSTR) | (1 << SPR1);	/* Enable SPI, Master, set clock rate fck/64 */
-	SPSR = 1 << SPI2X;								/* Double the clock rate (now: fck/32) */
+	SPCR = (1 << SPE) | (1 << MSTR) | SPI_INIT_SPR;	/* Enable SPI, Master, set clock rate fck/SPI_INIT_DIVIDER (100-400 kHz) */
+	SPSR = SPI_INIT_SPI2X << SPI2X;					/* SPI 2x mode if the divider requires it */
 
 	for (n = 10; n; n--) rcvr_mmc(buf, 1);	/* Apply 80 dummy clocks and the card gets ready to receive command */
 
@@ -378,6 +379,7 @@ DSTATUS disk_initialize (
 	{
 		Stat &= ~STA_NOINIT;	/* Clear STA_NOINIT */
 		SPCR &= 252;			/* set clock rate fck/2 (fck/4 + SPI 2x mode enabled) */
+		SPSR = 1 << SPI2X;		/* (SPI 2x mode may be off after initialization) */
 	}
 	else
 		Stat |= STA_NOINIT;
@@ -0,0 +1,285 @@
+/*
+ *  spill.c
+ *
+ *  Utworzono: 2015-01-24 10:31:07
+ *  Autor: Adam Grser
+ */
+
+#include <avr/eeprom.h>
+#include "spill.h"
+
+
+
+/// Kolejka rekordw oczekujcych na zapis do pamici EEPROM (bufor cykliczny, rekordy ju zakodowane).
+static uint8_t spill_queue[SPILL_QUEUE_SIZE][SPILL_RECORD_SIZE];
+
+/// Indeks pierwszego elementu kolejki.
+static uint8_t spill_queue_head = 0;
+
+/// Liczba rekordw w kolejce.
+static volatile uint8_t spill_pending = 0;
+
+/// Liczba bajtw pierwszego rekordu z kolejki, ktre zostay ju zapisane do pamici EEPROM.
+static uint8_t spill_byte = 0;
+
+/// Indeks najstarszego rekordu, ktry nie zosta jeszcze oznaczony w pamici EEPROM jako pusty.
+static volatile uint8_t spill_erase = 0;
+
+/// Indeks najstarszego rekordu w buforze.
+static volatile uint8_t spill_tail = 0;
+
+/// Indeks rekordu w pamici EEPROM, do ktrego zapisany zostanie pierwszy rekord z kolejki.
+static volatile uint8_t spill_write = 0;
+
+
+
+/**
+ * Indeks rekordu nastpujcego po wskazanym (bufor jest cykliczny).
+ * @param slot Indeks rekordu
+ * @return Indeks kolejnego rekordu
+ */
+static uint8_t SpillNext(uint8_t slot)
+{
+	return slot + 1 < SPILL_SLOTS ? slot + 1 : 0;
+}
+
+
+
+/**
+ * Liczba rekordw od indeksu 'from' (wcznie) do indeksu 'to' (wycznie).
+ * @param from Indeks pocztkowy
+ * @param to Indeks kocowy
+ * @return Liczba rekordw
+ */
+static uint8_t SpillDistance(uint8_t from, uint8_t to)
+{
+	return to >= from ? to - from : (uint16_t)to + SPILL_SLOTS - from;
+}
+
+
+
+/**
+ * Zapis kolejnego bajta do pamici EEPROM: bajta rekordu z kolejki, a jeli kolejka jest pusta - znacznika pustego rekordu.<br>
+ * Wywoywana, gdy pami EEPROM jest gotowa do zapisu, przy wyczonych przerwaniach. Jeli nie ma nic do zapisania, wycza przerwanie EE_RDY.
+ */
+static void SpillStep(void)
+{
+	uint16_t address;
+	uint8_t data;
+	/* bajty danych (od 1 do SPILL_RECORD_SIZE - 1) zapisywane s przed bajtem znacznika (0), wic przerwany zapis pozostawia rekord pusty */
+	uint8_t index = spill_byte + 1 < SPILL_RECORD_SIZE ? spill_byte + 1 : 0;
+
+	if(spill_pending)
+	{
+		address = (uint16_t)spill_write * SPILL_RECORD_SIZE + index;
+		data = spill_queue[spill_queue_head][index];
+
+		if(++spill_byte == SPILL_RECORD_SIZE)
+		{
+			spill_byte = 0;
+			spill_write = SpillNext(spill_write);
+			spill_queue_head = (spill_queue_head + 1) % SPILL_QUEUE_SIZE;
+			--spill_pending;
+		}
+	}
+	else if(spill_erase != spill_tail)
+	{
+		address = (uint16_t)spill_erase * SPILL_RECORD_SIZE;
+		data = 0xFF;
+		spill_erase = SpillNext(spill_erase);
+	}
+	else
+	{
+		EECR &= ~(1 << EERIE);
+
+		return;
+	}
+
+	/* komrka zawiera ju zapisywan warto - zapis (i zuycie komrki) nie jest potrzebny */
+	EEAR = address;
+	EECR |= 1 << EERE;
+
+	if(EEDR == data)
+		return;
+
+	EEDR = data;
+	EECR |= 1 << EEMWE;
+	EECR |= 1 << EEWE;
+}
+
+
+
+/**
+ * Obsuga przerwa z pamici EEPROM.<br>
+ * Zapis kolejnego bajta po zakoczeniu poprzedniego zapisu.
+ * @param EE_RDY_vect Wektor przerwania gotowoci pamici EEPROM.
+ */
+ISR(EE_RDY_vect)
+{
+	SpillStep();
+}
+
+
+
+void SpillInit(void)
+{
+	/* determinuj czy poprzedni i biecy rekord s zajte */
+	uint8_t previous, current;
+	/* zmienna iteracyjna */
+	uint8_t i;
+
+	spill_erase = spill_tail = spill_write = 0;
+
+	/* zajte rekordy tworz cigy fragment bufora - jego pocztek to najstarszy rekord, a koniec to miejsce na kolejny rekord */
+	previous = eeprom_read_byte((const uint8_t *)((SPILL_SLOTS - 1) * SPILL_RECORD_SIZE)) != 0xFF;
+
+	for(i = 0; i < SPILL_SLOTS; ++i)
+	{
+		current = eeprom_read_byte((const uint8_t *)((uint16_t)i * SPILL_RECORD_SIZE)) != 0xFF;
+
+		if(current && !previous)
+			spill_erase = spill_tail = i;
+		else if(!current && previous)
+			spill_write = i;
+
+		previous = current;
+	}
+}
+
+
+
+void SpillPack(uint8_t *record, const time *t, uint8_t code, uint8_t channel, uint8_t count)
+{
+	record[0] = code | t->hours << 3;
+	record[1] = t->minutes | (t->months & 3) << 6;
+	record[2] = t->seconds | (t->months >> 2) << 6;
+	record[3] = t->days | (t->milliseconds >> 8) << 5;
+	record[4] = t->milliseconds;
+	record[5] = t->years;
+	record[6] = channel;
+	record[7] = count;
+}
+
+
+
+void SpillUnpack(const uint8_t *record, time *t, uint8_t *code, uint8_t *channel, uint8_t *count)
+{
+	*code = record[0] & 7;
+	t->hours = record[0] >> 3;
+	t->minutes = record[1] & 63;
+	t->months = (record[1] >> 6) | (record[2] >> 6) << 2;
+	t->seconds = record[2] & 63;
+	t->days = record[3] & 31;
+	t->milliseconds = (uint16_t)((record[3] >> 5) & 3) << 8 | record[4];
+	t->years = record[5];
+	*channel = record[6];
+	*count = record[7];
+}
+
+
+
+uint8_t SpillPut(const time *t, uint8_t code, uint8_t channel, uint8_t count)
+{
+	uint8_t sreg = SREG;
+	uint8_t *record;
+	/* indeks rekordu w pamici EEPROM, do ktrego trafi nowy rekord */
+	uint8_t head;
+	/* zmienna iteracyjna */
+	uint8_t i;
+
+	cli();
+
+	head = spill_write;
+
+	for(i = 0; i < spill_pending; ++i)
+		head = SpillNext(head);
+
+	/* jeden rekord musi pozosta pusty, a rekordy usunite z bufora musz zosta najpierw oznaczone jako puste */
+	if(code > SPILL_MAX_CODE || spill_pending >= SPILL_QUEUE_SIZE || SpillNext(head) == spill_erase)
+	{
+		SREG = sreg;
+
+		return 0;
+	}
+
+	record = spill_queue[(spill_queue_head + spill_pending) % SPILL_QUEUE_SIZE];
+	SpillPack(record, t, code, channel, count);
+
+	++spill_pending;
+
+	/* wczenie przerwania EE_RDY - zapis rozpocznie si, gdy tylko pami EEPROM bdzie gotowa */
+	EECR |= 1 << EERIE;
+
+	SREG = sreg;
+
+	return 1;
+}
+
+
+
+uint8_t SpillCount(void)
+{
+	return SpillDistance(spill_tail, spill_write) + spill_pending;
+}
+
+
+
+uint8_t SpillPeek(time *t, uint8_t *code, uint8_t *channel, uint8_t *count)
+{
+	uint8_t sreg = SREG;
+	uint8_t record[SPILL_RECORD_SIZE];
+
+	/* odczyt pamici EEPROM nie moe zosta przerwany rozpoczciem zapisu w procedurze obsugi przerwania */
+	cli();
+
+	for(;;)
+	{
+		/* najstarszy rekord nie zosta jeszcze zapisany - dokoczenie zapisu z kolejki */
+		while(spill_tail == spill_write && spill_pending)
+		{
+			eeprom_busy_wait();
+			SpillStep();
+		}
+
+		if(spill_tail == spill_write)
+		{
+			SREG = sreg;
+
+			return 0;
+		}
+
+		eeprom_read_block(record, (const void *)((uint16_t)spill_tail * SPILL_RECORD_SIZE), SPILL_RECORD_SIZE);
+
+		SpillUnpack(record, t, code, channel, count);
+
+		if(*code <= SPILL_MAX_CODE && t->hours < 24 && t->minutes < 60 && t->seconds < 60 && t->months >= 1 && t->months <= 12
+			&& t->days >= 1 && t->milliseconds < 1000 && t->years < 100 && *channel <= 8)
+		{
+			SREG = sreg;
+
+			return 1;
+		}
+
+		/* rekord uszkodzony (np. pozostao po innym programie) */
+		SpillDrop();
+	}
+}
+
+
+
+void SpillDrop(void)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+
+	if(spill_tail != spill_write)
+	{
+		spill_tail = SpillNext(spill_tail);
+
+		/* oznaczenie rekordu jako pusty nastpi w procedurze obsugi przerwania EE_RDY */
+		EECR |= 1 << EERIE;
+	}
+
+	SREG = sreg;
+}
@@ -0,0 +1,108 @@
+/*
+ *  spill.h
+ *
+ *  Utworzono: 2015-01-24 10:31:07
+ *  Autor: Adam Grser
+ */
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint-gcc.h>
+#include "utils.h"
+#include "rtc.h"
+
+
+
+/**
+ * Rozmiar rekordu w pamici EEPROM (w bajtach).<br>
+ * Rekord zawiera kod zdarzenia (3 bity), dat i czas z milisekundami, numer drzwi i liczb zmian stanu drzwi, upakowane w kolejnych bajtach:
+ * [0] kod | godziny << 3, [1] minuty | (miesice & 3) << 6, [2] sekundy | (miesice >> 2) << 6, [3] dni | (milisekundy >> 8) << 5,
+ * [4] milisekundy & 0xFF, [5] lata, [6] numer drzwi, [7] liczba zmian.<br>
+ * Bajt [0] pustego rekordu ma warto 0xFF (w zajtym rekordzie godziny s mniejsze ni 24, wic nie moe on mie tej wartoci),
+ * dlatego zapisywany jest jako ostatni.
+ */
+#define SPILL_RECORD_SIZE 8
+
+/// Liczba rekordw mieszczcych si w pamici EEPROM (jeden z nich jest zawsze pusty i oddziela najnowszy rekord od najstarszego).
+#define SPILL_SLOTS ((E2END + 1) / SPILL_RECORD_SIZE)
+
+#if SPILL_SLOTS > 255
+#error SPILL_SLOTS does not fit in uint8_t, use a larger SPILL_RECORD_SIZE or reserve part of the EEPROM.
+#endif
+
+/// Najwikszy kod zdarzenia, jaki moe zosta zapisany w pamici EEPROM.
+#define SPILL_MAX_CODE 7
+
+/// Liczba rekordw oczekujcych w pamici RAM na zapis do pamici EEPROM (zapis jednego rekordu trwa ok. 50 ms).
+#define SPILL_QUEUE_SIZE 4
+
+
+
+/**
+ * Odtworzenie stanu bufora w pamici EEPROM po wczeniu urzdzenia (wyszukanie najstarszego i najnowszego rekordu).<br>
+ * Rekordy zapisane przed wyczeniem urzdzenia pozostaj w buforze.
+ */
+void SpillInit(void);
+
+/**
+ * Upakowanie daty i czasu zdarzenia, kodu zdarzenia, numeru drzwi i liczby zmian stanu drzwi w rekordzie o rozmiarze SPILL_RECORD_SIZE.<br>
+ * Ten sam ukad bajtw maj rekordy bufora w pamici RAM i rekordy binarnego pliku z logiem (patrz LOG_FORMAT w pliku config.h).
+ * @param record Tablica (co najmniej SPILL_RECORD_SIZE bajtw), do ktrej zapisany zostanie rekord
+ * @param t Data i czas zdarzenia
+ * @param code Kod zdarzenia (od 0 do SPILL_MAX_CODE)
+ * @param channel Numer drzwi (0 dla zdarze niezwizanych z drzwiami)
+ * @param count Liczba zmian stanu drzwi (0 dla zwykych rekordw)
+ */
+void SpillPack(uint8_t *record, const time *t, uint8_t code, uint8_t channel, uint8_t count);
+
+/**
+ * Rozpakowanie rekordu o rozmiarze SPILL_RECORD_SIZE (patrz @see SpillPack). Poprawno daty i kodu zdarzenia nie jest sprawdzana.
+ * @param record Rekord do rozpakowania
+ * @param t Struktura, do ktrej zapisane zostan data i czas zdarzenia
+ * @param code Zmienna, do ktrej zapisany zostanie kod zdarzenia
+ * @param channel Zmienna, do ktrej zapisany zostanie numer drzwi
+ * @param count Zmienna, do ktrej zapisana zostanie liczba zmian stanu drzwi
+ */
+void SpillUnpack(const uint8_t *record, time *t, uint8_t *code, uint8_t *channel, uint8_t *count);
+
+/**
+ * Dodanie rekordu do bufora w pamici EEPROM.<br>
+ * Rekord zapisywany jest w tle, bajt po bajcie, w procedurze obsugi przerwania EE_RDY. Bufor jest cykliczny,
+ * wic kada komrka pamici zapisywana jest tylko raz na peny obieg bufora (a bajt znacznika - dwa razy).
+ * @param t Data i czas zdarzenia
+ * @param code Kod zdarzenia (od 0 do SPILL_MAX_CODE)
+ * @param channel Numer drzwi (0 dla zdarze niezwizanych z drzwiami)
+ * @param count Liczba zmian stanu drzwi (0 dla zwykych rekordw)
+ * @return 1 jeli rekord zosta przyjty, 0 jeli bufor jest peny
+ */
+uint8_t SpillPut(const time *t, uint8_t code, uint8_t channel, uint8_t count);
+
+/**
+ * Liczba rekordw w buforze (cznie z oczekujcymi na zapis do pamici EEPROM).
+ * @return Liczba rekordw
+ */
+uint8_t SpillCount(void);
+
+/**
+ * Odczyt najstarszego rekordu z bufora (bez usuwania go). Rekordy z niepoprawn dat lub kodem s pomijane i usuwane.<br>
+ * Jeli najstarszy rekord oczekuje jeszcze na zapis do pamici EEPROM, funkcja czeka na zakoczenie zapisu.
+ * @param t Struktura, do ktrej zapisane zostan data i czas zdarzenia
+ * @param code Zmienna, do ktrej zapisany zostanie kod zdarzenia
+ * @param channel Zmienna, do ktrej zapisany zostanie numer drzwi
+ * @param count Zmienna, do ktrej zapisana zostanie liczba zmian stanu drzwi
+ * @return 1 jeli odczytano rekord, 0 jeli bufor jest pusty
+ */
+uint8_t SpillPeek(time *t, uint8_t *code, uint8_t *channel, uint8_t *count);
+
+/**
+ * Usunicie najstarszego rekordu z bufora (np. po zapisaniu go na karcie SD).<br>
+ * Rekord oznaczany jest jako pusty w tle - jeli urzdzenie zostanie wyczone wczeniej, rekord zostanie przepisany ponownie.
+ */
+void SpillDrop(void);
+
+
+
+#endif /* SPILL_H */
@@ -0,0 +1,224 @@
+/*
+ *  timing.h
+ *
+ *  Utworzono: 2015-02-14 10:05:37
+ *  Autor: Adam Grser
+ */
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <avr/io.h>
+#include "utils.h"
+
+/*
+ * Wszystkie stae zalene od czstotliwoci taktowania procesora (preskalery i wartoci rejestrw licznikw, dzielniki TWI i SPI)
+ * wyliczane s tutaj z F_CPU. Wartoci, ktrych nie da si uzyska przy danym F_CPU, zgaszane s bdem kompilacji.
+ * Opnienia _delay_ms/_delay_us (util/delay.h) i dly_us (sdmm.c) rwnie zale wycznie od F_CPU.
+ */
+
+#if F_CPU < 1000000UL || F_CPU >= 14000000UL
+#error F_CPU must be between 1 MHz and 14 MHz (dly_us in sdmm.c is calibrated up to 14 MHz).
+#endif
+
+
+
+#pragma region TimerCounter0
+
+/// Domylna czstotliwo prbkowania wej kontaktronw (w Hz). Zmiana stanu drzwi musi utrzyma si przez 4 kolejne prbki (ok. 80 ms, patrz @see DoorDebounce).
+#define DOOR_SCAN_HZ 50
+
+/// Preskaler licznika Timer/Counter0 - najwikszy dostpny, by czas eliminacji drga zestykw mona byo wyduy jak najbardziej.
+#define DOOR_SCAN_PRESCALER 1024
+
+/// Bity CS0x rejestru TCCR0 odpowiadajce preskalerowi DOOR_SCAN_PRESCALER.
+#define DOOR_SCAN_CLOCK_SELECT (1 << CS02 | 1 << CS00)
+
+/// Warto rejestru OCR0, przy ktrej Timer/Counter0 (tryb CTC) zgasza przerwanie DOOR_SCAN_HZ razy na sekund.
+#define DOOR_SCAN_OCR ((F_CPU + DOOR_SCAN_PRESCALER * DOOR_SCAN_HZ / 2) / DOOR_SCAN_PRESCALER / DOOR_SCAN_HZ - 1)
+
+#if DOOR_SCAN_OCR > 255
+#error DOOR_SCAN_OCR does not fit in OCR0, lower F_CPU or raise DOOR_SCAN_HZ.
+#endif
+
+#pragma endregion TimerCounter0
+
+
+
+#pragma region TimerCounter1
+
+/// Preskaler licznika Timer/Counter1 odmierzajcego czci sekundy (najmniejszy, przy ktrym sekunda mieci si w 16 bitach).
+#if F_CPU / 64 < 65536
+	#define SUBSECOND_PRESCALER 64
+	#define SUBSECOND_CLOCK_SELECT (1 << CS11 | 1 << CS10)
+#else
+	#define SUBSECOND_PRESCALER 256
+	#define SUBSECOND_CLOCK_SELECT (1 << CS12)
+#endif
+
+/// Liczba taktw licznika Timer/Counter1 w cigu sekundy.
+#define SUBSECOND_TICKS (F_CPU / SUBSECOND_PRESCALER)
+
+#if SUBSECOND_TICKS > 65535 || SUBSECOND_TICKS < 1000
+#error SUBSECOND_TICKS must fit in Timer/Counter1 and resolve milliseconds.
+#endif
+
+#pragma endregion TimerCounter1
+
+
+
+#pragma region TimerCounter2
+
+/// Czstotliwo przerwa licznika Timer/Counter2 sterujcego diodami (w Hz, podzielna przez 4 - patrz wiartki sekundy w led.c).
+#define LED_TICK_HZ 100
+
+#if LED_TICK_HZ % 4
+#error LED_TICK_HZ must be a multiple of 4.
+#endif
+
+/// Preskaler licznika Timer/Counter2 (najmniejszy, przy ktrym warto OCR2 mieci si w 8 bitach - najdokadniejsza czstotliwo przerwa).
+#if F_CPU / 64 / LED_TICK_HZ <= 256
+	#define LED_TICK_PRESCALER 64
+	#define LED_TICK_CLOCK_SELECT (1 << CS22)
+#elif F_CPU / 128 / LED_TICK_HZ <= 256
+	#define LED_TICK_PRESCALER 128
+	#define LED_TICK_CLOCK_SELECT (1 << CS22 | 1 << CS20)
+#elif F_CPU / 256 / LED_TICK_HZ <= 256
+	#define LED_TICK_PRESCALER 256
+	#define LED_TICK_CLOCK_SELECT (1 << CS22 | 1 << CS21)
+#else
+	#define LED_TICK_PRESCALER 1024
+	#define LED_TICK_CLOCK_SELECT (1 << CS22 | 1 << CS21 | 1 << CS20)
+#endif
+
+/// Warto rejestru OCR2, przy ktrej Timer/Counter2 (tryb CTC) zgasza przerwanie LED_TICK_HZ razy na sekund.
+#define LED_TICK_OCR ((F_CPU + LED_TICK_PRESCALER * LED_TICK_HZ / 2) / LED_TICK_PRESCALER / LED_TICK_HZ - 1)
+
+#if LED_TICK_OCR > 255 || LED_TICK_OCR < 1
+#error LED_TICK_OCR does not fit in OCR2, change LED_TICK_HZ.
+#endif
+
+/**
+ * Czstotliwo przerwa licznika Timer/Counter2, gdy diody nie migaj i przerwania potrzebne s tylko do odmierzania sekund (w Hz).<br>
+ * Najmniejsza osigalna przy preskalerze 1024 spord dzielnikw LED_TICK_HZ nie mniejszych ni 4 (przerwanie co najmniej raz na wiartk sekundy).
+ */
+#if F_CPU / 1024 / 4 <= 256
+	#define LED_IDLE_HZ 4
+#elif F_CPU / 1024 / 10 <= 256
+	#define LED_IDLE_HZ 10
+#elif F_CPU / 1024 / 20 <= 256
+	#define LED_IDLE_HZ 20
+#elif F_CPU / 1024 / 25 <= 256
+	#define LED_IDLE_HZ 25
+#elif F_CPU / 1024 / 50 <= 256
+	#define LED_IDLE_HZ 50
+#else
+	#define LED_IDLE_HZ LED_TICK_HZ
+#endif
+
+#if LED_TICK_HZ % LED_IDLE_HZ
+#error LED_IDLE_HZ must divide LED_TICK_HZ.
+#endif
+
+/// Bity CS2x rejestru TCCR2 odpowiadajce preskalerowi 1024, uywanemu przy czstotliwoci LED_IDLE_HZ.
+#define LED_IDLE_CLOCK_SELECT (1 << CS22 | 1 << CS21 | 1 << CS20)
+
+/// Warto rejestru OCR2, przy ktrej Timer/Counter2 (tryb CTC) zgasza przerwanie LED_IDLE_HZ razy na sekund.
+#define LED_IDLE_OCR ((F_CPU + 1024UL * LED_IDLE_HZ / 2) / 1024 / LED_IDLE_HZ - 1)
+
+/// Liczba przerwa o czstotliwoci LED_TICK_HZ, ktrym odpowiada jedno przerwanie o czstotliwoci LED_IDLE_HZ.
+#define LED_IDLE_STEP (LED_TICK_HZ / LED_IDLE_HZ)
+
+#pragma endregion TimerCounter2
+
+
+
+#pragma region TWI
+
+/**
+ * Docelowa czstotliwo sygnau SCL w Hz (maksymalna obsugiwana przez PCF8563P).<br>
+ * Jest to grna granica, a nie czstotliwo gwarantowana: przy TWBR >= TWI_TWBR_MIN osigalna jest dopiero od F_CPU = 14,4 MHz,
+ * a przy domylnym F_CPU = 1 MHz magistrala pracuje z czstotliwoci ok. 27,8 KHz.
+ */
+#define TWI_SCL 400000UL
+
+/// Najmniejsza warto rejestru TWBR dopuszczalna w trybie master (nota katalogowa ATmega32, rozdzia TWI Bit Rate Generator Unit).
+#define TWI_TWBR_MIN 10
+
+/**
+ * Warto rejestru TWBR wyliczona z F_CPU (zaokrglona w gr, aby nie przekroczy TWI_SCL), przy TWPS = 0:
+ * SCL = F_CPU / (16 + 2 * TWBR).<br>
+ * Wynik jest ograniczany od dou do TWI_TWBR_MIN - jeli zegar procesora jest zbyt wolny, by osign TWI_SCL,
+ * uywana jest najwysza czstotliwo zgodna z not katalogow, F_CPU / (16 + 2 * TWI_TWBR_MIN).
+ */
+#define TWI_TWBR_RAW (F_CPU > 16 * TWI_SCL ? (F_CPU - 16 * TWI_SCL + 2 * TWI_SCL - 1) / (2 * TWI_SCL) : 0)
+#define TWI_TWBR (TWI_TWBR_RAW < TWI_TWBR_MIN ? TWI_TWBR_MIN : TWI_TWBR_RAW)
+
+#if TWI_TWBR < TWI_TWBR_MIN
+#error TWI_TWBR is below the datasheet minimum for master mode.
+#endif
+
+#if TWI_TWBR > 255
+#error TWI_SCL is too low for F_CPU.
+#endif
+
+#pragma endregion TWI
+
+
+
+#pragma region SPI
+
+/// Maksymalna czstotliwo sygnau SCK podczas inicjalizacji karty SD (w Hz).
+#define SPI_INIT_SCK 400000UL
+
+/**
+ * Dzielnik zegara SPI podczas inicjalizacji karty SD (najmniejszy, przy ktrym SCK nie przekracza SPI_INIT_SCK)
+ * oraz odpowiadajce mu bity SPR1:0 rejestru SPCR i bit SPI2X rejestru SPSR.
+ */
+#if F_CPU / 2 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 2
+	#define SPI_INIT_SPR 0
+	#define SPI_INIT_SPI2X 1
+#elif F_CPU / 4 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 4
+	#define SPI_INIT_SPR 0
+	#define SPI_INIT_SPI2X 0
+#elif F_CPU / 8 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 8
+	#define SPI_INIT_SPR (1 << SPR0)
+	#define SPI_INIT_SPI2X 1
+#elif F_CPU / 16 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 16
+	#define SPI_INIT_SPR (1 << SPR0)
+	#define SPI_INIT_SPI2X 0
+#elif F_CPU / 32 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 32
+	#define SPI_INIT_SPR (1 << SPR1)
+	#define SPI_INIT_SPI2X 1
+#elif F_CPU / 64 <= SPI_INIT_SCK
+	#define SPI_INIT_DIVIDER 64
+	#define SPI_INIT_SPR (1 << SPR1)
+	#define SPI_INIT_SPI2X 0
+#else
+	#define SPI_INIT_DIVIDER 128
+	#define SPI_INIT_SPR (1 << SPR1 | 1 << SPR0)
+	#define SPI_INIT_SPI2X 0
+#endif
+
+#if F_CPU / SPI_INIT_DIVIDER > SPI_INIT_SCK
+#error F_CPU is too high for SD card initialization.
+#endif
+
+/// Maksymalna czstotliwo sygnau SCK po inicjalizacji karty SD (w Hz).
+#define SPI_FAST_SCK 25000000UL
+
+/// Po inicjalizacji karty SD zegar SPI to F_CPU / 2 (SPR1:0 = 0, SPI2X = 1).
+#if F_CPU / 2 > SPI_FAST_SCK
+#error F_CPU / 2 exceeds SPI_FAST_SCK.
+#endif
+
+#pragma endregion SPI
+
+
+
+#endif /* TIMING_H */
@@ -0,0 +1,275 @@
+/*
+ *  twi.c
+ *
+ *  Utworzono: 2015-01-10 17:42:15
+ *  Autor: Adam Grser
+ */
+
+#include "twi.h"
+
+
+
+/// Warto rejestru TWCR wznawiajca prac moduu TWI po obsueniu biecego kroku transakcji.
+#define TWI_GO ((1 << TWINT) | (1 << TWEN) | (1 << TWIE))
+
+/// Kolejka transakcji (bufor cykliczny), pierwszy element to transakcja w trakcie realizacji.
+static twi_transfer *twi_queue[TWI_QUEUE_SIZE];
+
+/// Indeks pierwszego elementu kolejki.
+static volatile uint8_t twi_head = 0;
+
+/// Liczba transakcji w kolejce.
+static volatile uint8_t twi_count = 0;
+
+/// Liczba bajtw danych przesanych w biecej transakcji.
+static uint8_t twi_index = 0;
+
+/// Determinuje czy w biecej transakcji wysano ju adres rejestru.
+static uint8_t twi_reg_sent = 0;
+
+/// Licznik krokw wykonanych przez modu TWI, uywany przez funkcj @see TwiCheck
+static volatile uint8_t twi_progress = 0;
+
+/// Warto licznika twi_progress przy poprzednim wywoaniu funkcji @see TwiCheck
+static uint8_t twi_checked = 0;
+
+
+
+/**
+ * Zakoczenie biecej transakcji: usunicie jej z kolejki, wygenerowanie sygnau STOP (i START, jeli w kolejce czeka kolejna transakcja)
+ * oraz wywoanie funkcji zwrotnej.
+ * @param status Kocowy stan transakcji
+ */
+static void TwiFinish(uint8_t status)
+{
+	twi_transfer *transfer = twi_queue[twi_head];
+
+	twi_head = (twi_head + 1) % TWI_QUEUE_SIZE;
+	--twi_count;
+	twi_index = twi_reg_sent = 0;
+
+	/* sygna STOP, a po nim START kolejnej transakcji */
+	if(twi_count)
+		TWCR = TWI_GO | (1 << TWSTO) | (1 << TWSTA);
+	else
+		TWCR = TWI_GO | (1 << TWSTO);
+
+	transfer->status = status;
+
+	if(transfer->callback)
+		transfer->callback(transfer);
+}
+
+
+
+/// Wykonanie kolejnego kroku biecej transakcji, na podstawie kodu stanu z rejestru TWSR.
+static void TwiStep(void)
+{
+	twi_transfer *transfer = twi_queue[twi_head];
+
+	++twi_progress;
+
+	switch(TWSR & 0xF8)
+	{
+		/* wysano sygna START - wysanie adresu ukadu podrzdnego (do odczytu dopiero po wystawieniu adresu rejestru) */
+		case 0x08:
+		case 0x10:
+			TWDR = (transfer->read && twi_reg_sent) ? transfer->address | 1 : transfer->address;
+			TWCR = TWI_GO;
+		break;
+
+		/* ukad podrzdny potwierdzi adres (zapis) - wystawienie adresu rejestru */
+		case 0x18:
+			TWDR = transfer->reg;
+			twi_reg_sent = 1;
+			TWCR = TWI_GO;
+		break;
+
+		/* ukad podrzdny potwierdzi bajt danych */
+		case 0x28:
+			/* przy odczycie: powtrzony sygna START (bez zwalniania magistrali), po nim adres ukadu w trybie odczytu */
+			if(transfer->read)
+				TWCR = TWI_GO | (1 << TWSTA);
+			/* przy zapisie: wysanie kolejnego bajta danych */
+			else if(twi_index < transfer->length)
+			{
+				TWDR = transfer->data[twi_index++];
+				TWCR = TWI_GO;
+			}
+			else
+				TwiFinish(TWI_OK);
+		break;
+
+		/* ukad podrzdny potwierdzi adres (odczyt) - bit potwierdzenia wczany, jeli do odczytu jest wicej ni 1 bajt */
+		case 0x40:
+			TWCR = transfer->length > 1 ? TWI_GO | (1 << TWEA) : TWI_GO;
+		break;
+
+		/* odebrano bajt danych (z potwierdzeniem) - ostatni bajt odbierany jest bez potwierdzenia */
+		case 0x50:
+			transfer->data[twi_index++] = TWDR;
+			TWCR = twi_index < transfer->length - 1 ? TWI_GO | (1 << TWEA) : TWI_GO;
+		break;
+
+		/* odebrano ostatni bajt danych */
+		case 0x58:
+			transfer->data[twi_index++] = TWDR;
+			TwiFinish(TWI_OK);
+		break;
+
+		/* brak potwierdzenia, utrata arbitrau lub bd magistrali */
+		default:
+			TwiFinish(TWI_ERROR);
+	}
+}
+
+
+
+/// Przerwanie biecej transakcji i zwolnienie magistrali.
+static void TwiAbort(void)
+{
+	uint8_t sreg = SREG;
+
+	cli();
+
+	if(twi_count)
+	{
+		/* wyczenie moduu TWI zwalnia linie SDA i SCL */
+		TWCR = 0;
+		TWCR = (1 << TWEN) | (1 << TWIE);
+
+		TwiFinish(TWI_TIMEOUT);
+	}
+
+	SREG = sreg;
+}
+
+
+
+/**
+ * Obsuga przerwa z moduu TWI.<br>
+ * Realizacja kolejnego kroku biecej transakcji.
+ * @param TWI_vect Wektor przerwania moduu TWI.
+ */
+ISR(TWI_vect)
+{
+	TwiStep();
+}
+
+
+
+/**
+ * Wykonanie transakcji na bloku rejestrw i oczekiwanie na jej zakoczenie.
+ * @param address Adres ukadu podrzdnego w trybie zapisu
+ * @param reg Adres pierwszego rejestru
+ * @param read 1 = odczyt, 0 = zapis
+ * @param data Bufor na odczytane dane lub dane do zapisania
+ * @param length Liczba bajtw
+ * @return Kocowy stan transakcji (TWI_OK, TWI_ERROR lub TWI_TIMEOUT)
+ */
+static uint8_t TwiBlock(uint8_t address, uint8_t reg, uint8_t read, uint8_t *data, uint8_t length)
+{
+	twi_transfer transfer = { address, reg, read, length, data, 0, TWI_BUSY };
+
+	if(!TwiSubmit(&transfer))
+		return TWI_ERROR;
+
+	return TwiWait(&transfer);
+}
+
+
+
+void TwiInit(void)
+{
+	/* ustawienie czstotliwoci SCL:
+	       SCL frequency = CPU Clock frequency / (16 + 2(TWBR) * 4^TWPS), TWPS = 00 (warto domylna)
+	   warto TWBR wyliczana jest z F_CPU w pliku timing.h i nie schodzi poniej TWI_TWBR_MIN = 10 (minimum z noty katalogowej),
+	   wic 400 KHz osigalne jest dopiero od F_CPU = 14,4 MHz; przy 1 MHz SCL = 1 MHz / 36 = ok. 27,8 KHz, przy 8 MHz ok. 222 KHz */
+	TWBR = TWI_TWBR;
+
+	TWCR = (1 << TWEN) | (1 << TWIE);
+}
+
+
+
+uint8_t TwiSubmit(twi_transfer *transfer)
+{
+	uint8_t sreg = SREG;
+	/* ograniczenie czasu oczekiwania na zakoczenie sygnau STOP poprzedniej transakcji */
+	uint8_t i = 255;
+
+	cli();
+
+	if(twi_count >= TWI_QUEUE_SIZE)
+	{
+		SREG = sreg;
+
+		return 0;
+	}
+
+	transfer->status = TWI_BUSY;
+	twi_queue[(twi_head + twi_count) % TWI_QUEUE_SIZE] = transfer;
+
+	/* magistrala jest wolna - rozpoczcie transakcji */
+	if(!twi_count++)
+	{
+		while((TWCR & (1 << TWSTO)) && --i);
+
+		++twi_progress;
+		TWCR = TWI_GO | (1 << TWSTA);
+	}
+
+	SREG = sreg;
+
+	return 1;
+}
+
+
+
+uint8_t TwiWait(twi_transfer *transfer)
+{
+	/* licznik krokw oczekiwania po 100 us */
+	uint16_t i = TWI_TIMEOUT_MS * 10;
+
+	while(transfer->status == TWI_BUSY)
+	{
+		/* po przekroczeniu czasu oczekiwania przerywana jest transakcja z pocztku kolejki (niekoniecznie ta, na ktr czekamy),
+		 * dlatego czny czas oczekiwania nie przekroczy TWI_QUEUE_SIZE * TWI_TIMEOUT_MS */
+		if(!i--)
+		{
+			TwiAbort();
+			i = TWI_TIMEOUT_MS * 10;
+		}
+		/* przy wyczonych przerwaniach kolejne kroki transakcji wykonywane s tutaj */
+		else if(!(SREG & (1 << SREG_I)) && (TWCR & (1 << TWINT)))
+			TwiStep();
+		else
+			_delay_us(100);
+	}
+
+	return transfer->status;
+}
+
+
+
+void TwiCheck(void)
+{
+	if(twi_count && twi_progress == twi_checked)
+		TwiAbort();
+
+	twi_checked = twi_progress;
+}
+
+
+
+uint8_t TwiReadRegs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length)
+{
+	return TwiBlock(address, reg, 1, data, length);
+}
+
+
+
+uint8_t TwiWriteRegs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length)
+{
+	return TwiBlock(address, reg, 0, data, length);
+}
@@ -0,0 +1,115 @@
+/*
+ *  twi.h
+ *
+ *  Utworzono: 2015-01-10 17:42:15
+ *  Autor: Adam Grser
+ */
+
+#ifndef TWI_H
+#define TWI_H
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <stdint-gcc.h>
+#include "utils.h"
+#include "timing.h"
+
+
+
+/// Maksymalna liczba transakcji oczekujcych w kolejce (cznie z transakcj w trakcie realizacji).
+#define TWI_QUEUE_SIZE 4
+
+/// Maksymalny czas (w milisekundach) oczekiwania na zakoczenie transakcji przez funkcj @see TwiWait
+#define TWI_TIMEOUT_MS 20
+
+///@name Stany_transakcji_TWI
+//@{
+	/// Transakcja oczekuje w kolejce lub jest w trakcie realizacji.
+	#define TWI_BUSY 0
+	/// Transakcja zakoczya si powodzeniem.
+	#define TWI_OK 1
+	/// Ukad podrzdny nie potwierdzi adresu lub danych, albo wystpi bd magistrali.
+	#define TWI_ERROR 2
+	/// Transakcja zostaa przerwana po przekroczeniu czasu oczekiwania.
+	#define TWI_TIMEOUT 3
+//@}
+
+struct twi_transfer;
+
+/// Funkcja wywoywana po zakoczeniu transakcji (take z procedury obsugi przerwania TWI).
+typedef void (*twi_callback)(struct twi_transfer *transfer);
+
+/**
+ * Opisuje transakcj odczytu lub zapisu bloku kolejnych rejestrw ukadu podrzdnego.<br>
+ * Struktura naley do wywoujcego i nie moe zosta zwolniona ani zmieniona, dopki pole status ma warto TWI_BUSY.
+ * @field address Adres ukadu podrzdnego w trybie zapisu (np. 0xA2 dla PCF8563P)
+ * @field reg Adres pierwszego rejestru
+ * @field read 1 = odczyt bloku rejestrw, 0 = zapis
+ * @field length Liczba bajtw do odczytania lub zapisania
+ * @field data Bufor na odczytane dane lub dane do zapisania
+ * @field callback Funkcja wywoywana po zakoczeniu transakcji (moe mie warto NULL)
+ * @field status Stan transakcji (jedna ze staych TWI_BUSY, TWI_OK, TWI_ERROR, TWI_TIMEOUT)
+ */
+typedef struct twi_transfer {
+	uint8_t address;
+	uint8_t reg;
+	uint8_t read;
+	uint8_t length;
+	uint8_t *data;
+	twi_callback callback;
+	volatile uint8_t status;
+} twi_transfer;
+
+
+
+/// Wczenie moduu TWI wraz z przerwaniem TWI_vect i ustawienie czstotliwoci SCL.
+void TwiInit(void);
+
+/**
+ * Dodanie transakcji do kolejki. Jeli magistrala jest wolna, transakcja rozpoczyna si natychmiast.<br>
+ * Dalsza realizacja odbywa si w procedurze obsugi przerwania TWI, a przy wyczonych przerwaniach - w funkcji @see TwiWait
+ * @param transfer Opis transakcji
+ * @return 1 jeli transakcja zostaa dodana do kolejki, 0 jeli kolejka jest pena
+ */
+uint8_t TwiSubmit(twi_transfer *transfer);
+
+/**
+ * Oczekiwanie na zakoczenie transakcji, nie duej ni TWI_TIMEOUT_MS milisekund.<br>
+ * Przy wyczonych przerwaniach (np. wewntrz procedury obsugi innego przerwania) funkcja sama realizuje kolejne kroki transakcji.
+ * Po przekroczeniu czasu oczekiwania bieca transakcja jest przerywana, a magistrala zwalniana.
+ * @param transfer Transakcja dodana wczeniej funkcj @see TwiSubmit
+ * @return Kocowy stan transakcji (TWI_OK, TWI_ERROR lub TWI_TIMEOUT)
+ */
+uint8_t TwiWait(twi_transfer *transfer);
+
+/**
+ * Kontrola postpu transakcji realizowanych w tle, wywoywana okresowo (np. w ptli gwnej programu).<br>
+ * Jeli od poprzedniego wywoania bieca transakcja nie wykonaa adnego kroku, zostaje przerwana.
+ */
+void TwiCheck(void);
+
+/**
+ * Odczyt bloku kolejnych rejestrw w jednej transakcji (adres rejestru, powtrzony sygna START, odczyt danych).<br>
+ * Funkcja czeka na zakoczenie transakcji (patrz @see TwiWait).
+ * @param address Adres ukadu podrzdnego w trybie zapisu
+ * @param reg Adres pierwszego rejestru
+ * @param data Bufor na odczytane dane
+ * @param length Liczba bajtw do odczytania
+ * @return Kocowy stan transakcji (TWI_OK, TWI_ERROR lub TWI_TIMEOUT)
+ */
+uint8_t TwiReadRegs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length);
+
+/**
+ * Zapis bloku kolejnych rejestrw w jednej transakcji.<br>
+ * Funkcja czeka na zakoczenie transakcji (patrz @see TwiWait).
+ * @param address Adres ukadu podrzdnego w trybie zapisu
+ * @param reg Adres pierwszego rejestru
+ * @param data Dane do zapisania
+ * @param length Liczba bajtw do zapisania
+ * @return Kocowy stan transakcji (TWI_OK, TWI_ERROR lub TWI_TIMEOUT)
+ */
+uint8_t TwiWriteRegs(uint8_t address, uint8_t reg, uint8_t *data, uint8_t length);
+
+
+
+#endif /* TWI_H */
@@ -8,8 +8,13 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-/// Czstotliwo taktowania procesora. Zdefiniowane dla uniknicia ostrzeenia kompilatora w util/delay.h
+/**
+ * Czstotliwo taktowania procesora. Zdefiniowane dla uniknicia ostrzeenia kompilatora w util/delay.h<br>
+ * Mona j nadpisa w ustawieniach kompilacji (-DF_CPU=...) - stae zalene od niej wyliczane s w pliku timing.h.
+ */
+#ifndef F_CPU
 #define F_CPU 1000000UL
+#endif
 
 #include <util/delay.h>
 
@@ -17,25 +22,19 @@
 
 /**
  * Pole bitowe przechowujce flagi m.in. bdw.
- * @field led1 Biecy stan diody zielonej
- * @field led2 Biecy stan diody czerwonej
  * @field vl Warto bitu VL z rejestru VL_seconds w RTC (warto 1 informuje o moliwoci utracenia dokadnoci pomiaru czasu)
  * @field no_sd_card Flaga braku moliwego do zamontowania systemu plikw
  * @field buffer_full Flaga zapenienia bufora przy jednoczesnym braku karty SD (jeli no_sd_card == 1) lub flaga bdu zapisu danych na kart SD
  * @field sd_communication_error Flaga bdu uywana wewntrz funkcji @see SaveBuffer
  * @field interrupts Flaga determinujca moliwo wczenia przerwa
- * @field reed_switch Biecy stan kontaktronu
  */
 typedef struct
 {
-	uint8_t led1:1,
-			led2:1,
-			vl:1,
+	uint8_t vl:1,
 			no_sd_card:1,
 			buffer_full:1,
 			sd_communication_error:1,
-			interrupts:1,
-			reed_switch:1;
+			interrupts:1;
 } flags;
 
 
@@ -73,134 +72,6 @@ extern volatile flags device_flags;
 	set_rtc_values[Years] = 14; \
 }
 
-/**
- * Miga zielon diod wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia.
- * @param repeats Liczba migni.
- * @param green_on Czas w milisekundach, przez jaki dioda ma si wieci.
- * @param green_off Czas w milisekundach, przez jaki dioda ma si nie wieci.
- */
-#define BlinkGreen(repeats, green_on, green_off) \
-{ \
-	/* zapisanie stanu diody, zgaszenie jej i odczekanie 'green_off' milisekund */ \
-	if((PIND & (1 << PIND7))) \
-	{ \
-		device_flags.led1 = 1; \
-		PORTD &= 127; \
-	} \
-	_delay_ms(green_off); \
-\
-	/* mignicie diod wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia */ \
-	/* zamiast tworzy now zmienn, uyto nieuywanego rejestru Output Compare Register Timer/Counter0 */ \
-	for(OCR0 = 0; OCR0 < repeats; ++OCR0) \
-	{ \
-		PORTD |= 128; \
-		_delay_ms(green_on); \
-\
-		PORTD &= 127; \
-		_delay_ms(green_off); \
-	} \
-\
-	/* przywrcenie stanu diody */ \
-	PORTD |= device_flags.led1 << PD7; \
-\
-	/* wyczyszczenie flagi z zapisanym stanem diody */ \
-	device_flags.led1 = 0; \
-}
-
-/**
- * Miga czerwon diod wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia.
- * @param repeats Liczba migni.
- * @param red_on Czas w milisekundach, przez jaki dioda ma si wieci.
- * @param red_off Czas w milisekundach, przez jaki dioda ma si nie wieci.
- */
-#define BlinkRed(repeats, red_on, red_off) \
-{ \
-	/* zapisanie stanu diody, zgaszenie jej i odczekanie 'red_off' milisekund */ \
-	if((PIND & (1 << PIND6))) \
-	{ \
-		device_flags.led2 = 1; \
-		PORTD &= 191; \
-	} \
-	_delay_ms(red_off); \
-\
-	/* mignicie diod wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia */ \
-	/* zamiast tworzy now zmienn, uyto nieuywanego rejestru Output Compare Register Timer/Counter0 */ \
-	for(OCR0 = 0; OCR0 < repeats; ++OCR0) \
-	{ \
-		PORTD |= 64; \
-		_delay_ms(red_on); \
-\
-		PORTD &= 191; \
-		_delay_ms(red_off); \
-	} \
-\
-	/* przywrcenie stanu diody */ \
-	PORTD |= device_flags.led2 << PD6; \
-\
-	/* wyczyszczenie flagi z zapisanym stanem diody */ \
-	device_flags.led2 = 0; \
-}
-
-
-
-/**
- * Miga obiema diodami wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia.
- * @param repeats Liczba migni.
- * @param on Czas w milisekundach, przez jaki diody maj si wieci.
- * @param off Czas w milisekundach, przez jaki diody maj si nie wieci.
- */
-#define BlinkBoth(repeats, on, off) \
-{ \
-	/* zapisanie stanu diod, zgaszenie ich i odczekanie 'off' milisekund */ \
-	if((PIND & (1 << PIND7))) \
-	{ \
-		device_flags.led1 = 1; \
-		PORTD &= 127; \
-	} \
-	if((PIND & (1 << PIND6))) \
-	{ \
-		device_flags.led2 = 1; \
-		PORTD &= 191; \
-	} \
-	_delay_ms(off); \
-\
-	/* mignicie diodami wskazan ilo razy, z podanymi czasami wiecenia i niewiecenia */ \
-	/* zamiast tworzy now zmienn, uyto nieuywanego rejestru Output Compare Register Timer/Counter0 */ \
-	for(OCR0 = 0; OCR0 < repeats; ++OCR0) \
-	{ \
-		PORTD |= 192; \
-		_delay_ms(on); \
-\
-		PORTD &= 63; \
-		_delay_ms(off); \
-	} \
-\
-	/* przywrcenie stanu diod */ \
-	PORTD |= device_flags.led1 << PD7 | device_flags.led2 << PD6; \
-\
-	/* wyczyszczenie flag z zapisanymi stanami diod */ \
-	device_flags.led1 = device_flags.led2 = 0; \
-}
-
-
-
-/**
- * Wywouje funkcj _delay_ms z biblioteki utils/delay.h 'd' razy, podajc jako argument warto 't'.<br>
- * Po kadym wywoaniu opnienia funkcja ta wcza ponownie przerwania (_delay_ms wycza przerwania).
- * @param d Liczba powtrze opnienia
- * @param t Czas opnienia w milisekundach
- */
-#define delay(d, t) \
-{ \
-	OCR0 = d; \
-\
-	do \
-	{ \
-		_delay_ms(t); \
-		sei(); \
-	} while (--OCR0); \
-}
-
 
 
 #endif /* UTILS_H */